@@ -19,40 +19,88 @@
  */
 #include <Api.h>
 //------------------------------------------------------------------------------
-// Buffer sizes
-/** Size of the temporary buffer used to read API path */
-uint16_t const API_PATH_BUFFER_SIZE = 160;
-/** Size of the temporary buffer used to construct POST data */
-uint16_t const API_POST_DATA_BUFFER_SIZE = 160;
-/** Size of the temporary buffer used to read API host */
-uint8_t const API_HOST_BUFFER_SIZE = WIFLY_HOST_BUFFER_SIZE;
+/**
+ * Construct an instance of ApiQuery.
+ *
+ * \param[in] args The key-value arguments, which must remain valid for as
+ * long as the query is printed.
+ * \param[in] count The number of arguments.
+ * \param[in] baseUrl The path of the API on the host, NULL to only print the
+ * arguments, e.g. as the body of a POST request.
+ * \param[in] method The method to call.
+ * \param[in] continued true if more arguments are printed after the query,
+ * in which case a separator follows the last argument.
+ */
+ApiQuery::ApiQuery(const ApiArg* args, uint8_t count, PGM_P baseUrl,
+        PGM_P method, bool continued) :
+    args_(args),
+    count_(count),
+    baseUrl_(baseUrl),
+    method_(method),
+    continued_(continued)
+{
+}
 //------------------------------------------------------------------------------
-// API path format strings
-/** Format string for an API call with the base URL and fixed arguments */
-const char PROGMEM API_CALL_NO_PARAMS[] = "%S%S?%s";
-/** API call with 1 additionnal key-value argument */
-const char PROGMEM API_CALL_ONE_PARAM[] = "%S%S?%s&%S=%s";
-/** API call with 2 additionnal key-value arguments */
-const char PROGMEM API_CALL_TWO_PARAMS[] = "%S%S?%s&%S=%s&%S=%s";
-/** API call with 3 additionnal key-value arguments */
-const char PROGMEM API_CALL_THREE_PARAMS[] = "%S%S?%s&%S=%s&%S=%s&%S=%s";
-/** API call with 4 additionnal key-value arguments */
-const char PROGMEM API_CALL_FOUR_PARAMS[] = "%S%S?%s&%S=%s&%S=%s&%S=%s&%S=%s";
+/**
+ * Print a value, percent-encoding every character but the unreserved ones.
+ *
+ * \param[out] p The Print instance the value is to be printed to.
+ * \param[in] value The null-terminated value.
+ *
+ * \return The number of bytes printed.
+ */
+size_t ApiQuery::printEncoded(Print& p, const char* value) {
+    size_t n = 0;
+    for (; *value != 0x00; value++) {
+        char c = *value;
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')
+            || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.'
+            || c == '~') {
+            n += p.write(c);
+        }
+        else {
+            uint8_t high = (uint8_t)c >> 4;
+            uint8_t low = (uint8_t)c & 0x0F;
+            n += p.write('%');
+            n += p.write(high < 10 ? '0' + high : 'A' + high - 10);
+            n += p.write(low < 10 ? '0' + low : 'A' + low - 10);
+        }
+    }
+    return n;
+}
 //------------------------------------------------------------------------------
-// POST request body format strings
-/** Request body with 1 key-value argument */
-const char PROGMEM POST_DATA_ONE_PARAM[] = "%S=%s";
-/** Request body with 2 key-value arguments */
-const char PROGMEM POST_DATA_TWO_PARAMS[] = "%S=%s&%S=%s";
-/** Request body with 3 key-value arguments */
-const char PROGMEM POST_DATA_THREE_PARAMS[] = "%S=%s&%S=%s&%S=%s";
-/** Request body with 4 key-value arguments */
-const char PROGMEM POST_DATA_FOUR_PARAMS[] = "%S=%s&%S=%s&%S=%s&%S=%s";
+/**
+ * Print the path of the API call, or the arguments alone when there is no
+ * base URL.
+ *
+ * \param[out] p The Print instance the query is to be printed to.
+ *
+ * \return The number of bytes printed.
+ */
+size_t ApiQuery::printTo(Print& p) const {
+    size_t n = 0;
+    if (baseUrl_ != NULL) {
+        n += p.print((const __FlashStringHelper*)baseUrl_);
+        n += p.print((const __FlashStringHelper*)method_);
+        n += p.print('?');
+    }
+    for (uint8_t i = 0; i < count_; i++) {
+        if (i > 0)
+            n += p.print('&');
+        n += p.print((const __FlashStringHelper*)args_[i].key);
+        n += p.print('=');
+        n += printEncoded(p, args_[i].value);
+    }
+    if (continued_ && count_ > 0)
+        n += p.print('&');
+    return n;
+}
 //------------------------------------------------------------------------------
 /**
  * Construct an instance of Api.
  *
  * \param[in] wifly The Wifly object used to connect to the internet.
+ * \param[in] scratch The arena providing the prepared block.
  * \param[out] buffer The buffer where the response will be written.
  * \param[in] bufferSize The size of the output buffer.
  * \param[in] host The remote host where the API is located.
@@ -60,15 +108,21 @@ const char PROGMEM POST_DATA_FOUR_PARAMS[] = "%S=%s&%S=%s&%S=%s&%S=%s";
  * \param[in] fixedArgs A string which will be sent with each API request.
  *
  * \note The API path needs to be in the program memory, whereas the fixed
- * arguments should be a string in the RAM.
+ * arguments should be a string in the RAM. They may be filled later, since
+ * nothing is rendered before prepare() is called.
  */
- Api::Api(Wifly &wifly, char* buffer, size_t bufferSize, PGM_P host,
-        PGM_P baseUrl, char* fixedArgs) :
+ Api::Api(Wifly &wifly, ScratchArena &scratch, char* buffer,
+        size_t bufferSize, PGM_P host, PGM_P baseUrl, char* fixedArgs) :
     HttpClient(wifly),
     JsonStream(buffer, bufferSize),
-    host_(host),
     baseUrl_(baseUrl),
-    fixedArgs_(fixedArgs)
+    host_(host),
+    fixedArgs_(fixedArgs),
+    scratch_(&scratch),
+    checkpoint_(0),
+    blockSize_(0),
+    hostCopy_(NULL),
+    prepared_(NULL)
 {
 }
 //------------------------------------------------------------------------------
@@ -76,6 +130,7 @@ const char PROGMEM POST_DATA_FOUR_PARAMS[] = "%S=%s&%S=%s&%S=%s&%S=%s";
  * Construct an instance of Api.
  *
  * \param[in] wifly The Wifly object used to connect to the internet.
+ * \param[in] scratch The arena providing the prepared block.
  * \param[out] buffer The buffer where the response will be written.
  * \param[in] bufferSize The size of the output buffer.
  * \param[in] host The remote host where the API is located.
@@ -84,41 +139,21 @@ const char PROGMEM POST_DATA_FOUR_PARAMS[] = "%S=%s&%S=%s&%S=%s&%S=%s";
  * \note The API path needs to be in the program memory, whereas the fixed
  *arguments should be a string in the RAM.
  */
- Api::Api(Wifly &wifly, char* buffer, size_t bufferSize, PGM_P host,
-        PGM_P baseUrl) :
+ Api::Api(Wifly &wifly, ScratchArena &scratch, char* buffer,
+        size_t bufferSize, PGM_P host, PGM_P baseUrl) :
     HttpClient(wifly),
     JsonStream(buffer, bufferSize),
+    baseUrl_(baseUrl),
     host_(host),
-    baseUrl_(baseUrl)
+    scratch_(&scratch),
+    checkpoint_(0),
+    blockSize_(0),
+    hostCopy_(NULL),
+    prepared_(NULL)
 {
     fixedArgs_ = "";
 }
-//------------------------------------------------------------------------------
-/**
- * Send a call to the API without any arguments.
- *
- * \param[in] method The method to call.
- *
- * \return The number of bytes actually received, -1 in case of failure.
- */
-int Api::call(PGM_P method) {
-    if (!connected()) {
-        return -1;
-    }
-    char path[API_PATH_BUFFER_SIZE] = {0};
-    snprintf_P(
-        path,
-        API_PATH_BUFFER_SIZE,
-        API_CALL_NO_PARAMS,
-        baseUrl_,
-        method,
-        fixedArgs_
-    );
-    char host[WIFLY_HOST_BUFFER_SIZE] = {0};
-    strlcpy_P(host, host_, WIFLY_HOST_BUFFER_SIZE);
-    int nBytes = get(buffer_, bufferSize_, host, path);
-    return nBytes;
-}
+#if __cplusplus < 201103L
 //------------------------------------------------------------------------------
 /**
  * Send a call to the API with one argument.
@@ -130,21 +165,8 @@ int Api::call(PGM_P method) {
  * \return The number of bytes actually received, -1 in case of failure.
  */
 int Api::call(PGM_P method, PGM_P key1, const char* value1) {
-    if (!connected())
-        return -1;
-    char path[API_PATH_BUFFER_SIZE] = {0};
-    snprintf_P(
-        path,
-        API_PATH_BUFFER_SIZE,
-        API_CALL_ONE_PARAM,
-        baseUrl_,
-        method,
-        fixedArgs_,
-        key1, value1
-    );
-    char host[API_PATH_BUFFER_SIZE] = {0};
-    strlcpy_P(host, host_, API_PATH_BUFFER_SIZE);
-    return get(buffer_, bufferSize_, host, path);
+    ApiArg args[] = {{key1, value1}};
+    return send(method, args, 1, false);
 }
 //------------------------------------------------------------------------------
 /**
@@ -160,22 +182,8 @@ int Api::call(PGM_P method, PGM_P key1, const char* value1) {
  */
 int Api::call(PGM_P method, PGM_P key1, const char* value1, PGM_P key2,
     const char* value2) {
-    if (!connected())
-        return -1;
-    char path[API_PATH_BUFFER_SIZE] = {0};
-    snprintf_P(
-        path,
-        API_PATH_BUFFER_SIZE,
-        API_CALL_TWO_PARAMS,
-        baseUrl_,
-        method,
-        fixedArgs_,
-        key1, value1,
-        key2, value2
-    );
-    char host[API_PATH_BUFFER_SIZE] = {0};
-    strlcpy_P(host, host_, API_PATH_BUFFER_SIZE);
-    return get(buffer_, bufferSize_, host, path);
+    ApiArg args[] = {{key1, value1}, {key2, value2}};
+    return send(method, args, 2, false);
 }
 //------------------------------------------------------------------------------
 /**
@@ -193,23 +201,8 @@ int Api::call(PGM_P method, PGM_P key1, const char* value1, PGM_P key2,
  */
 int Api::call(PGM_P method, PGM_P key1, const char* value1, PGM_P key2,
     const char* value2, PGM_P key3, const char* value3) {
-    if (!connected())
-        return -1;
-    char path[API_PATH_BUFFER_SIZE] = {0};
-    snprintf_P(
-        path,
-        API_PATH_BUFFER_SIZE,
-        API_CALL_THREE_PARAMS,
-        baseUrl_,
-        method,
-        fixedArgs_,
-        key1, value1,
-        key2, value2,
-        key3, value3
-    );
-    char host[API_PATH_BUFFER_SIZE] = {0};
-    strlcpy_P(host, host_, API_PATH_BUFFER_SIZE);
-    return get(buffer_, bufferSize_, host, path);
+    ApiArg args[] = {{key1, value1}, {key2, value2}, {key3, value3}};
+    return send(method, args, 3, false);
 }
 //------------------------------------------------------------------------------
 /**
@@ -230,50 +223,9 @@ int Api::call(PGM_P method, PGM_P key1, const char* value1, PGM_P key2,
 int Api::call(PGM_P method, PGM_P key1, const char* value1, PGM_P key2,
     const char* value2, PGM_P key3, const char* value3, PGM_P key4,
     const char* value4) {
-    if (!connected())
-        return -1;
-    char path[API_PATH_BUFFER_SIZE] = {0};
-    snprintf_P(
-        path,
-        API_PATH_BUFFER_SIZE,
-        API_CALL_FOUR_PARAMS,
-        baseUrl_,
-        method,
-        fixedArgs_,
-        key1, value1,
-        key2, value2,
-        key3, value3,
-        key4, value4
-    );
-    char host[API_PATH_BUFFER_SIZE] = {0};
-    strlcpy_P(host, host_, API_PATH_BUFFER_SIZE);
-    return get(buffer_, bufferSize_, host, path);
-}
-//------------------------------------------------------------------------------
-/**
- * Send a call to the API without any arguments.
- *
- * \param[in] method The method to call.
- *
- * \return The number of bytes actually received, -1 in case of failure.
- */
-int Api::post(PGM_P method) {
-    if (!connected()) {
-        return -1;
-    }
-    char path[API_PATH_BUFFER_SIZE] = {0};
-    snprintf_P(
-        path,
-        API_PATH_BUFFER_SIZE,
-        API_CALL_NO_PARAMS,
-        baseUrl_,
-        method,
-        fixedArgs_
-    );
-    char host[API_HOST_BUFFER_SIZE] = {0};
-    strlcpy_P(host, host_, API_HOST_BUFFER_SIZE);
-    int nBytes = HttpClient::post(buffer_, bufferSize_, host, path, "");
-    return nBytes;
+    ApiArg args[] = {{key1, value1}, {key2, value2}, {key3, value3},
+        {key4, value4}};
+    return send(method, args, 4, false);
 }
 //------------------------------------------------------------------------------
 /**
@@ -286,28 +238,8 @@ int Api::post(PGM_P method) {
  * \return The number of bytes actually received, -1 in case of failure.
  */
 int Api::post(PGM_P method, PGM_P key1, const char* value1) {
-    if (!connected())
-        return -1;
-    char path[API_PATH_BUFFER_SIZE] = {0};
-    snprintf_P(
-        path,
-        API_PATH_BUFFER_SIZE,
-        API_CALL_NO_PARAMS,
-        baseUrl_,
-        method,
-        fixedArgs_
-    );
-    char host[API_HOST_BUFFER_SIZE] = {0};
-    strlcpy_P(host, host_, API_HOST_BUFFER_SIZE);
-    char content[API_POST_DATA_BUFFER_SIZE] = {0};
-    snprintf_P(
-        content,
-        API_POST_DATA_BUFFER_SIZE,
-        POST_DATA_ONE_PARAM,
-        key1,
-        value1
-    );
-    return HttpClient::post(buffer_, bufferSize_, host, path, content);
+    ApiArg args[] = {{key1, value1}};
+    return send(method, args, 1, true);
 }
 //------------------------------------------------------------------------------
 /**
@@ -323,30 +255,8 @@ int Api::post(PGM_P method, PGM_P key1, const char* value1) {
  */
 int Api::post(PGM_P method, PGM_P key1, const char* value1, PGM_P key2,
     const char* value2) {
-    if (!connected())
-        return -1;
-    char path[API_PATH_BUFFER_SIZE] = {0};
-    snprintf_P(
-        path,
-        API_PATH_BUFFER_SIZE,
-        API_CALL_NO_PARAMS,
-        baseUrl_,
-        method,
-        fixedArgs_
-    );
-    char host[API_HOST_BUFFER_SIZE] = {0};
-    strlcpy_P(host, host_, API_HOST_BUFFER_SIZE);
-    char content[API_POST_DATA_BUFFER_SIZE] = {0};
-    snprintf_P(
-        content,
-        API_POST_DATA_BUFFER_SIZE,
-        POST_DATA_TWO_PARAMS,
-        key1,
-        value1,
-        key2,
-        value2
-    );
-    return HttpClient::post(buffer_, bufferSize_, host, path, content);
+    ApiArg args[] = {{key1, value1}, {key2, value2}};
+    return send(method, args, 2, true);
 }
 //------------------------------------------------------------------------------
 /**
@@ -364,32 +274,8 @@ int Api::post(PGM_P method, PGM_P key1, const char* value1, PGM_P key2,
  */
 int Api::post(PGM_P method, PGM_P key1, const char* value1, PGM_P key2,
     const char* value2, PGM_P key3, const char* value3) {
-    if (!connected())
-        return -1;
-    char path[API_PATH_BUFFER_SIZE] = {0};
-    snprintf_P(
-        path,
-        API_PATH_BUFFER_SIZE,
-        API_CALL_NO_PARAMS,
-        baseUrl_,
-        method,
-        fixedArgs_
-    );
-    char host[API_HOST_BUFFER_SIZE] = {0};
-    strlcpy_P(host, host_, API_HOST_BUFFER_SIZE);
-    char content[API_POST_DATA_BUFFER_SIZE] = {0};
-    snprintf_P(
-        content,
-        API_POST_DATA_BUFFER_SIZE,
-        POST_DATA_THREE_PARAMS,
-        key1,
-        value1,
-        key2,
-        value2,
-        key3,
-        value3
-    );
-    return HttpClient::post(buffer_, bufferSize_, host, path, content);
+    ApiArg args[] = {{key1, value1}, {key2, value2}, {key3, value3}};
+    return send(method, args, 3, true);
 }
 //------------------------------------------------------------------------------
 /**
@@ -410,34 +296,31 @@ int Api::post(PGM_P method, PGM_P key1, const char* value1, PGM_P key2,
 int Api::post(PGM_P method, PGM_P key1, const char* value1, PGM_P key2,
     const char* value2, PGM_P key3, const char* value3, PGM_P key4,
     const char* value4) {
+    ApiArg args[] = {{key1, value1}, {key2, value2}, {key3, value3},
+        {key4, value4}};
+    return send(method, args, 4, true);
+}
+#endif
+//------------------------------------------------------------------------------
+/**
+ * Send a POST request to the API with a structured body, e.g. JSON generated
+ * by a JsonWriter.
+ *
+ * \param[in] method The method to call.
+ * \param[in] content The body, which is printed straight to the Wifly once its
+ * length has been measured.
+ *
+ * \return The number of bytes actually received, -1 in case of failure.
+ */
+int Api::post(PGM_P method, const Printable& content) {
     if (!connected())
         return -1;
-    char path[API_PATH_BUFFER_SIZE] = {0};
-    snprintf_P(
-        path,
-        API_PATH_BUFFER_SIZE,
-        API_CALL_NO_PARAMS,
-        baseUrl_,
-        method,
-        fixedArgs_
-    );
-    char host[API_HOST_BUFFER_SIZE] = {0};
-    strlcpy_P(host, host_, API_HOST_BUFFER_SIZE);
-    char content[API_POST_DATA_BUFFER_SIZE] = {0};
-    snprintf_P(
-        content,
-        API_POST_DATA_BUFFER_SIZE,
-        POST_DATA_FOUR_PARAMS,
-        key1,
-        value1,
-        key2,
-        value2,
-        key3,
-        value3,
-        key4,
-        value4
-    );
-    return HttpClient::post(buffer_, bufferSize_, host, path, content);
+    if (prepared_ == NULL)
+        return -1;
+    // the response replaces the document which may have been indexed
+    index(NULL, 0);
+    ApiQuery path(NULL, 0, baseUrl_, method);
+    return postPrepared(buffer_, bufferSize_, path, prepared_, content);
 }
 //------------------------------------------------------------------------------
 /**
@@ -447,9 +330,9 @@ int Api::post(PGM_P method, PGM_P key1, const char* value1, PGM_P key2,
  * Otherwise, false is returned.
  */
 bool Api::connect() {
-    char host[WIFLY_HOST_BUFFER_SIZE] = {0};
-    strlcpy_P(host, host_, WIFLY_HOST_BUFFER_SIZE);
-    return HttpClient::connect(host);
+    if (hostCopy_ == NULL)
+        return false;
+    return HttpClient::connect(hostCopy_);
 }
 //------------------------------------------------------------------------------
 /** Check whether the client is connected to the host */
@@ -457,12 +340,90 @@ bool Api::connected() {
     return wifly_->connectedTo_P(host_);
 }
 //------------------------------------------------------------------------------
+/**
+ * Render the part of the requests which does not change from one call to the
+ * next: the host name, used to connect, and the fixed arguments followed by
+ * the end of the command line and the common header fields.
+ *
+ * \return true is returned if the requests can be sent, false if the scratch
+ * arena is exhausted.
+ *
+ * \note No request is sent before this method has been called. The fixed
+ * arguments are copied, so it has to be called again whenever the string
+ * they live in changes, e.g. once the credentials have been loaded.
+ *
+ * \note The block stays allocated in the arena. It is resized when it is the
+ * last allocation of the arena, otherwise a new rendering has to fit in it.
+ */
+bool Api::prepare() {
+    prepared_ = NULL;
+    // measure the prepared header, the host name aside
+    size_t hostLength = strlen_P(host_);
+    LengthCounter counter;
+    counter.print(fixedArgs_);
+    prepareHeader(counter, "", F_KEEP_ALIVE);
+    size_t preparedSize = counter.getLength() + hostLength + 1;
+    size_t blockSize = hostLength + 1 + preparedSize;
+    // a block at the end of the arena can be given back and resized
+    bool last = (scratch_->getUsed() == checkpoint_ + blockSize_);
+    if (hostCopy_ != NULL && last) {
+        scratch_->release(checkpoint_);
+        hostCopy_ = NULL;
+    }
+    if (hostCopy_ == NULL) {
+        checkpoint_ = scratch_->getUsed();
+        hostCopy_ = (char*)scratch_->allocate(blockSize);
+        if (hostCopy_ == NULL)
+            return false;
+        blockSize_ = blockSize;
+    }
+    else if (blockSize > blockSize_)
+        return false;
+    else
+        memset(hostCopy_, 0x00, blockSize_);
+    strcpy_P(hostCopy_, host_);
+    prepared_ = hostCopy_ + hostLength + 1;
+    BufferedStream prepared(prepared_, preparedSize);
+    prepared.print(fixedArgs_);
+    prepareHeader(prepared, hostCopy_, F_KEEP_ALIVE);
+    return true;
+}
+//------------------------------------------------------------------------------
 /**
  * Provide a pointer to a null-terminated string which will automatically be
  * appended to any call made by the API instance.
  *
  * \param[in] data The arguments added to each API call.
+ *
+ * \return true is returned if the requests can be sent, see prepare().
  */
-void Api::setFixedArgs(char* data) {
+bool Api::setFixedArgs(char* data) {
     fixedArgs_ = data;
+    return prepare();
+}
+//------------------------------------------------------------------------------
+/**
+ * Send a call to the API, printing the method and the arguments straight to
+ * the request before replaying the prepared header.
+ *
+ * \param[in] method The method to call.
+ * \param[in] args The key-value arguments.
+ * \param[in] count The number of arguments.
+ * \param[in] form true to send a POST request with the arguments as the body,
+ * false to send a GET request with the arguments in the path.
+ *
+ * \return The number of bytes actually received, -1 in case of failure.
+ */
+int Api::send(PGM_P method, const ApiArg* args, uint8_t count, bool form) {
+    if (!connected() || prepared_ == NULL)
+        return -1;
+    // the response replaces the document which may have been indexed
+    index(NULL, 0);
+    if (!form) {
+        ApiQuery path(args, count, baseUrl_, method, fixedArgs_[0] != 0x00);
+        return getPrepared(buffer_, bufferSize_, path, prepared_);
+    }
+    ApiQuery path(NULL, 0, baseUrl_, method);
+    ApiQuery content(args, count);
+    return postPrepared(buffer_, bufferSize_, path, prepared_, content);
 }
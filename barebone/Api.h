@@ -26,18 +26,127 @@
 #include <avr/pgmspace.h>
 #include <HttpClient.h>
 #include <JsonStream.h>
+#include <JsonWriter.h>
+#include <ScratchArena.h>
+//------------------------------------------------------------------------------
+/**
+ * \struct ApiArg
+ * \brief Key-value argument of an API call.
+ */
+struct ApiArg {
+    /** Name of the parameter in program memory */
+    PGM_P key;
+    /** Value of the parameter, percent-encoded when it is printed */
+    const char* value;
+};
+//------------------------------------------------------------------------------
+/**
+ * \class ApiQuery
+ * \brief Printable generating the path of an API call, or the form body of
+ * a POST request, from key-value arguments.
+ *
+ * Nothing is formatted beforehand: the arguments are printed straight to the
+ * request, which saves the intermediate buffers. The fixed arguments of the
+ * Api are not part of the query, they are replayed with the rest of the
+ * prepared header.
+ */
+class ApiQuery : public Printable {
+public:
+    ApiQuery(const ApiArg* args, uint8_t count, PGM_P baseUrl = NULL,
+        PGM_P method = NULL, bool continued = false);
+    virtual size_t printTo(Print& p) const;
+//------------------------------------------------------------------------------
+private:
+    static size_t printEncoded(Print& p, const char* value);
+    /** Arguments to print */
+    const ApiArg* args_;
+    /** Number of arguments */
+    uint8_t count_;
+    /** Base URL of the API, NULL to print the arguments alone */
+    PGM_P baseUrl_;
+    /** Method to call */
+    PGM_P method_;
+    /** Whether more arguments follow the query */
+    bool continued_;
+};
 //------------------------------------------------------------------------------
 /**
  * \class Api
  * \brief Send formatted requests to a an API and parse the JSON responses.
+ *
+ * Calls take any number of key-value arguments, keys in program memory and
+ * values in the RAM, e.g. call(METHOD, KEY1, value1, KEY2, value2). Compilers
+ * without C++11 support are limited to four arguments.
+ *
+ * The part of the requests which does not change, fixed arguments included,
+ * is rendered once by prepare() or setFixedArgs(), which must be called
+ * before the first request and again whenever the fixed arguments change.
+ * It is kept in the scratch arena, outside of any ScratchScope, so prepare()
+ * must not be called while a scope of the same arena is open.
  */
 class Api : public HttpClient, public JsonStream {
 public:
-    Api(Wifly &wifly, char* buffer, size_t bufferSize, PGM_P host,
-        PGM_P baseUrl);
-    Api(Wifly &wifly, char* buffer, size_t bufferSize, PGM_P host,
-        PGM_P baseUrl, char* fixedArgs);
-    int call(PGM_P method);
+    Api(Wifly &wifly, ScratchArena &scratch, char* buffer,
+        size_t bufferSize, PGM_P host, PGM_P baseUrl);
+    Api(Wifly &wifly, ScratchArena &scratch, char* buffer,
+        size_t bufferSize, PGM_P host, PGM_P baseUrl, char* fixedArgs);
+    /**
+     * Send a call to the API without any arguments.
+     *
+     * \param[in] method The method to call.
+     *
+     * \return The number of bytes actually received, -1 in case of failure.
+     */
+    int call(PGM_P method) {return send(method, NULL, 0, false);}
+    /**
+     * Send a POST request to the API without any arguments.
+     *
+     * \param[in] method The method to call.
+     *
+     * \return The number of bytes actually received, -1 in case of failure.
+     */
+    int post(PGM_P method) {return send(method, NULL, 0, true);}
+    int post(PGM_P method, const Printable& content);
+#if __cplusplus >= 201103L
+    /**
+     * Send a call to the API.
+     *
+     * \param[in] method The method to call.
+     * \param[in] key Name of the first parameter in program memory.
+     * \param[in] value String value of the first parameter.
+     * \param[in] pairs Names of the next parameters, each followed by its
+     * value.
+     *
+     * \return The number of bytes actually received, -1 in case of failure.
+     */
+    template<typename... Pairs> int call(PGM_P method, PGM_P key,
+        const char* value, Pairs... pairs) {
+        static_assert(sizeof...(pairs) % 2 == 0,
+            "arguments must be key-value pairs");
+        ApiArg args[sizeof...(pairs) / 2 + 1];
+        fillArgs(args, key, value, pairs...);
+        return send(method, args, sizeof...(pairs) / 2 + 1, false);
+    }
+    /**
+     * Send a POST request to the API, with the arguments in the body.
+     *
+     * \param[in] method The method to call.
+     * \param[in] key Name of the first parameter in program memory.
+     * \param[in] value String value of the first parameter.
+     * \param[in] pairs Names of the next parameters, each followed by its
+     * value.
+     *
+     * \return The number of bytes actually received, -1 in case of failure.
+     */
+    template<typename... Pairs> int post(PGM_P method, PGM_P key,
+        const char* value, Pairs... pairs) {
+        static_assert(sizeof...(pairs) % 2 == 0,
+            "arguments must be key-value pairs");
+        ApiArg args[sizeof...(pairs) / 2 + 1];
+        fillArgs(args, key, value, pairs...);
+        return send(method, args, sizeof...(pairs) / 2 + 1, true);
+    }
+#else
     int call(PGM_P method, PGM_P key1, const char* value1);
     int call(PGM_P method, PGM_P key1, const char* value1, PGM_P key2,
         const char* value2);
@@ -46,7 +155,6 @@ public:
     int call(PGM_P method, PGM_P key1, const char* value1, PGM_P key2,
         const char* value2, PGM_P key3, const char* value3, PGM_P key4,
         const char* value4);
-    int post(PGM_P method);
     int post(PGM_P method, PGM_P key1, const char* value1);
     int post(PGM_P method, PGM_P key1, const char* value1, PGM_P key2,
         const char* value2);
@@ -55,18 +163,45 @@ public:
     int post(PGM_P method, PGM_P key1, const char* value1, PGM_P key2,
         const char* value2, PGM_P key3, const char* value3, PGM_P key4,
         const char* value4);
+#endif
     bool connect();
     bool connected();
-    void setFixedArgs(char* data);
+    bool prepare();
+    bool setFixedArgs(char* data);
     using HttpClient::disconnect;
 //------------------------------------------------------------------------------
 private:
+    int send(PGM_P method, const ApiArg* args, uint8_t count, bool form);
+#if __cplusplus >= 201103L
+    /** End of the recursion over the arguments */
+    static void fillArgs(ApiArg*) {}
+    /** Store the next key-value pair, then the following ones */
+    template<typename... Pairs> static void fillArgs(ApiArg* args, PGM_P key,
+        const char* value, Pairs... pairs) {
+        args->key = key;
+        args->value = value;
+        fillArgs(args + 1, pairs...);
+    }
+#endif
     /** Base URL of the API calls */
     PGM_P baseUrl_;
     /** Host where the API resides */
     PGM_P host_;
     /** Arguments added to each API call*/
     char* fixedArgs_;
+    /** Arena providing the prepared block */
+    ScratchArena* scratch_;
+    /** Checkpoint of the arena before the prepared block was allocated */
+    size_t checkpoint_;
+    /** Size of the prepared block */
+    size_t blockSize_;
+    /**
+     * Host name in the RAM, followed by the fixed arguments and the common
+     * header fields, NULL if they could not be allocated
+     */
+    char* hostCopy_;
+    /** Fixed arguments and common header fields, within hostCopy_ */
+    char* prepared_;
 };
 
 #endif // API_H
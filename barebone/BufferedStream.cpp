@@ -65,7 +65,38 @@ int BufferedStream::read() {
     return (available() > 0) ? buffer_[index_++] : -1;
 }
 //------------------------------------------------------------------------------
-/** Write a byte to the buffer */
+/**
+ * Copy unread bytes from the buffer.
+ *
+ * \param[out] buffer Address of the buffer to write data to.
+ * \param[in] length Maximum number of bytes to copy.
+ *
+ * \return The number of bytes copied.
+ */
+int BufferedStream::readBlock(char* buffer, size_t length) {
+    size_t nBytes = available();
+    if (nBytes > length)
+        nBytes = length;
+    memcpy(buffer, buffer_ + index_, nBytes);
+    index_ += nBytes;
+    return nBytes;
+}
+//------------------------------------------------------------------------------
+/**
+ * Write a byte to the buffer at the current position, keeping the buffer
+ * null-terminated.
+ *
+ * \param[in] c The byte to write.
+ *
+ * \return 1 is returned if the byte is written, 0 if the buffer is full, in
+ * which case the write error is set.
+ */
 size_t BufferedStream::write(uint8_t c) {
-    return 0;
+    if ((size_t)index_ + 1 >= bufferSize_) {
+        setWriteError();
+        return 0;
+    }
+    buffer_[index_++] = c;
+    buffer_[index_] = 0x00;
+    return 1;
 }
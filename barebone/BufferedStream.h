@@ -21,7 +21,7 @@
 #define BUFFERED_STREAM_H
 /**
  * \file
- * \brief BufferedStream class to read data from buffers.
+ * \brief BufferedStream class to read and write data in buffers.
  */
 #include <ExtendedStream.h>
 //------------------------------------------------------------------------------
@@ -35,8 +35,10 @@ public:
     virtual int available();
     virtual size_t printTo(Print& p) const;
     virtual int read();
+    virtual int readBlock(char* buffer, size_t length);
     virtual void rewind() { index_ = 0; }
-    virtual size_t write(uint8_t);
+    virtual size_t write(uint8_t c);
+    using Print::write;
 //------------------------------------------------------------------------------
 protected:
     /** Buffer to read data from */
@@ -19,6 +19,9 @@
  */
 #include <ExtendedStream.h>
 //------------------------------------------------------------------------------
+/** Size of the staging buffer used to copy PROGMEM strings to the stream */
+uint8_t const WRITE_P_BUFFER_SIZE = 16;
+//------------------------------------------------------------------------------
 /**
  * Reads data from serial port until the target character is found.
  *
@@ -45,22 +48,10 @@ bool ExtendedStream::find(char target) {
  * \return true if the target string is found, false if timed out.
  */
 bool ExtendedStream::find(const char* target) {
-    uint8_t targetLength = strlen(target);
-    uint8_t targetIndex = 0;
-    int c = 0;
-    do {
-        c = timedRead();
-        // compare new character to the next one in target string
-        if ((char)c == target[targetIndex])
-            targetIndex++;
-        else
-            targetIndex = 0;
-        // if the whole target string was found, return true
-        if (targetIndex == targetLength)
-            return true;
-    } while (c >= 0);
-    // if c is -1, it means a timeout occured
-    return false;
+    Matcher matcher;
+    if (!matcher.load(target))
+        return false;
+    return find(matcher);
 }
 //------------------------------------------------------------------------------
 /**
@@ -71,66 +62,48 @@ bool ExtendedStream::find(const char* target) {
  * \return true if the target string is found, false if timed out.
  */
 bool ExtendedStream::find_P(PGM_P target) {
-    uint8_t targetLength = strlen_P(target);
-    uint8_t targetIndex = 0;
-    int c = 0;
+    Matcher matcher;
+    if (!matcher.load_P(target))
+        return false;
+    return find(matcher);
+}
+//------------------------------------------------------------------------------
+/**
+ * Reads data from serial port until the pattern of the matcher is found.
+ *
+ * \param[in] target The matcher loaded with the string to look for.
+ *
+ * \return true if the target string is found, false if timed out.
+ */
+bool ExtendedStream::find(Matcher &target) {
+    if (target.empty())
+        return true;
     do {
-        c = timedRead();
-        // compare new character to the next one in target string
-        if ((char)c == pgm_read_byte(target + targetIndex))
-            targetIndex++;
-        else
-            targetIndex = 0;
-        // if the whole target string was found, return true
-        if (targetIndex == targetLength)
+        int c = timedRead();
+        // if c is -1, it means a timeout occured
+        if (c < 0)
+            return false;
+        if (target.match((char)c))
             return true;
-    } while (c >= 0);
-    // if c is -1, it means a timeout occured
-    return false;
+    } while (1);
 }
 //------------------------------------------------------------------------------
 /**
- * Like findUntil() but with target and terminator strings residing in program
- * memory.
+ * Reads data from serial port until the target string is found, unless the
+ * terminator string is found first.
  *
- * \param[in] target The PROGMEM string to find in the incoming stream.
- * \param[in] terminator Upon encountering this PROGMEM string, the search will
- * stop.
+ * \param[in] target The string to find in the incoming stream.
+ * \param[in] terminator Upon encountering this string, the search will stop.
  *
  * \return true if the target string is found, false if the terminator string
  * is encountered or a timeout occurs.
  */
 bool ExtendedStream::findUntil(char* target, char* terminator) {
-    uint8_t targetLength = strlen(target);
-    uint8_t termLength = strlen(terminator);
-    uint8_t targetIndex = 0;
-    uint8_t termIndex = 0;
-
-    // return true if target is a null string
-    if (pgm_read_byte(target) == 0)
-        return true;
-
-    int c = 0;
-    do {
-        c = timedRead();
-
-        // compare new character to the next one in target string
-        if ((char)c == target[targetIndex])
-            targetIndex++;
-        else
-            targetIndex = 0;
-        if (targetIndex == targetLength)
-            return true;
-        // compare new character to the next one in terminator string
-        if ((char)c == terminator[termIndex])
-            termIndex++;
-        else
-            termIndex = 0;
-        if (termIndex == termLength)
-            return false;
-    }  while (c >= 0);
-    // if c is -1, it means a timeout occured
-    return false;
+    Matcher targetMatcher;
+    Matcher termMatcher;
+    if (!targetMatcher.load(target) || !termMatcher.load(terminator))
+        return false;
+    return findUntil(targetMatcher, termMatcher);
 }
 //------------------------------------------------------------------------------
 /**
@@ -145,37 +118,38 @@ bool ExtendedStream::findUntil(char* target, char* terminator) {
  * is encountered or a timeout occurs.
  */
 bool ExtendedStream::findUntil_P(PGM_P target, PGM_P terminator) {
-    uint8_t targetLength = strlen_P(target);
-    uint8_t termLength = strlen_P(terminator);
-    uint8_t targetIndex = 0;
-    uint8_t termIndex = 0;
-
+    Matcher targetMatcher;
+    Matcher termMatcher;
+    if (!targetMatcher.load_P(target) || !termMatcher.load_P(terminator))
+        return false;
+    return findUntil(targetMatcher, termMatcher);
+}
+//------------------------------------------------------------------------------
+/**
+ * Run the target and terminator automata side by side over the incoming
+ * stream, so that each character is read exactly once.
+ *
+ * \param[in] target The matcher loaded with the string to look for.
+ * \param[in] terminator The matcher loaded with the string which stops the
+ * search.
+ *
+ * \return true if the target string is found, false if the terminator string
+ * is encountered or a timeout occurs.
+ */
+bool ExtendedStream::findUntil(Matcher &target, Matcher &terminator) {
     // return true if target is a null string
-    if (pgm_read_byte(target) == 0)
+    if (target.empty())
         return true;
-
-    int c = 0;
     do {
-        c = timedRead();
-
-        // compare new character to the next one in target string
-        if ((char)c == pgm_read_byte(target + targetIndex)) {
-            targetIndex++;
-        }
-        else
-            targetIndex = 0;
-        if (targetIndex == targetLength)
+        int c = timedRead();
+        // if c is -1, it means a timeout occured
+        if (c < 0)
+            return false;
+        if (target.match((char)c))
             return true;
-        // compare new character to the next one in terminator string
-        if ((char)c == pgm_read_byte(terminator + termIndex))
-            termIndex++;
-        else
-            termIndex = 0;
-        if (termIndex == termLength)
+        if (terminator.match((char)c))
             return false;
-    }  while (c >= 0);
-    // if c is -1, it means a timeout occured
-    return false;
+    } while (1);
 }
 //------------------------------------------------------------------------------
 /**
@@ -191,18 +165,48 @@ bool ExtendedStream::findUntil_P(PGM_P target, PGM_P terminator) {
  * \note Unlike Stream::readBytes, this implementation won't stop at null
  * characters and it won't add a null character at the end of the received data,
  * because it has to work with binary data (e.g MP3 files) containing null
- * bytes.
+ * bytes. After a short read, the byte which follows the received data is
+ * cleared, so that text can still be used as a string.
  */
 int ExtendedStream::readBytes(char* buffer, size_t length) {
-    uint16_t index = 0;
-    memset(buffer, 0x00, length);
+    size_t index = 0;
     while (index < length) {
+        // copy whatever has already been received in one go
+        int nBytes = readBlock(buffer + index, length - index);
+        if (nBytes > 0) {
+            index += nBytes;
+            continue;
+        }
+        // otherwise wait for the next byte
         int c = timedRead();
         if (c < 0)
             break;
         else
             buffer[index++] = (char)c;
     }
+    if (index < length)
+        buffer[index] = 0x00;
+    return index;
+}
+//------------------------------------------------------------------------------
+/**
+ * Copy the characters which are already available into buffer, without
+ * waiting for more data.
+ *
+ * \param[out] buffer Address of the buffer to write data to.
+ * \param[in] length Maximum number of bytes to read into the buffer.
+ *
+ * \return The number of characters placed in the buffer (0 means no data was
+ * available).
+ */
+int ExtendedStream::readBlock(char* buffer, size_t length) {
+    size_t index = 0;
+    while (index < length && available() > 0) {
+        int c = read();
+        if (c < 0)
+            break;
+        buffer[index++] = (char)c;
+    }
     return index;
 }
 //------------------------------------------------------------------------------
@@ -216,10 +220,14 @@ int ExtendedStream::readBytes(char* buffer, size_t length) {
  *
  * \return The number of characters placed in the buffer (0 means no valid data
  * found).
+ *
+ * \note The received data is followed by a null character, so at most
+ * length - 1 characters are read.
  */
 int ExtendedStream::readBytesUntil(char terminator, char* buffer, size_t length) {
     uint16_t index = 0;
-    memset(buffer, 0x00, length);
+    if (length == 0)
+        return 0;
     while (index < length - 1) {
         int c = timedRead();
         if (c < 0)
@@ -229,6 +237,7 @@ int ExtendedStream::readBytesUntil(char terminator, char* buffer, size_t length)
         else
             buffer[index++] = (char)c;
     }
+    buffer[index] = 0x00;
     return index;
 }
 //------------------------------------------------------------------------------
@@ -244,21 +253,10 @@ int ExtendedStream::readBytesUntil(char terminator, char* buffer, size_t length)
  * found).
  */
 int ExtendedStream::readBytesUntil(const char* terminator, char* buffer, size_t length) {
-    uint8_t termLength = strlen(terminator);
-    uint8_t termIndex = 0;
-    uint16_t index = 0;
-    memset(buffer, 0x00, length);
-    while ((index < length - 1) && (termIndex < termLength)) {
-        int c = timedRead();
-        if (c < 0)
-            break;
-        buffer[index++] = (char)c;
-        if ((char)c == terminator[termIndex])
-            termIndex++;
-        else
-            termIndex = 0;
-    }
-    return index;
+    Matcher matcher;
+    if (!matcher.load(terminator))
+        return 0;
+    return readBytesUntil(matcher, buffer, length);
 }
 //------------------------------------------------------------------------------
 /**
@@ -274,20 +272,41 @@ int ExtendedStream::readBytesUntil(const char* terminator, char* buffer, size_t
  * found).
  */
 int ExtendedStream::readBytesUntil_P(PGM_P terminator, char* buffer, size_t length) {
-    uint8_t termLength = strlen_P(terminator);
-    uint8_t termIndex = 0;
+    Matcher matcher;
+    if (!matcher.load_P(terminator))
+        return 0;
+    return readBytesUntil(matcher, buffer, length);
+}
+//------------------------------------------------------------------------------
+/**
+ * Read characters from serial port into buffer until the pattern of the
+ * matcher is found, length characters have been read or a timeout occurs. The
+ * terminator itself is written to the buffer.
+ *
+ * \param[in] terminator The matcher loaded with the terminator string.
+ * \param[out] buffer Address of the buffer to write data to.
+ * \param[in] length Number of bytes to read into the buffer.
+ *
+ * \return The number of characters placed in the buffer (0 means no valid data
+ * found).
+ *
+ * \note The received data is followed by a null character, so at most
+ * length - 1 characters are read.
+ */
+int ExtendedStream::readBytesUntil(Matcher &terminator, char* buffer,
+    size_t length) {
     uint16_t index = 0;
-    memset(buffer, 0x00, length);
-    while ((index < length - 1) && (termIndex < termLength)) {
+    if (length == 0)
+        return 0;
+    while (index < length - 1 && !terminator.empty()) {
         int c = timedRead();
         if (c < 0)
             break;
         buffer[index++] = (char)c;
-        if ((char)c == pgm_read_byte(terminator + termIndex))
-            termIndex++;
-        else
-            termIndex = 0;
+        if (terminator.match((char)c))
+            break;
     }
+    buffer[index] = 0x00;
     return index;
 }
 //------------------------------------------------------------------------------
@@ -311,17 +330,26 @@ int ExtendedStream::timedRead() {
  * \param[in] source The Flash-based string to send.
  *
  * \return The number of characters written is returned.
+ *
+ * \note Flash is copied to a small staging buffer which is handed to
+ * write(const uint8_t*, size_t), so that streams supporting block writes are
+ * not called once per character.
  */
 size_t ExtendedStream::write_P(PGM_P source) {
+    uint8_t buffer[WRITE_P_BUFFER_SIZE];
     size_t n = 0;
+    uint8_t length = 0;
     do {
         uint8_t ch = pgm_read_byte(source++);
+        // hand the staging buffer over when it is full or the string ends
+        if (ch == 0x00 || length == WRITE_P_BUFFER_SIZE) {
+            if (length > 0)
+                n += write(buffer, length);
+            length = 0;
+        }
         if (ch == 0x00)
             break;
-        else {
-            write(ch);
-            n++;
-        }
+        buffer[length++] = ch;
     } while (1);
     return n;
 }
@@ -25,6 +25,7 @@
  */
 #include <Arduino.h>
 #include <Print.h>
+#include <Matcher.h>
 //------------------------------------------------------------------------------
 /**
  * \class ExtendedStream
@@ -51,14 +52,18 @@ public:
      * value -1 is returned.
      */
     virtual int read() = 0;
+    virtual int readBlock(char* buffer, size_t length);
     bool find(char target);
     bool find(const char* target);
+    bool find(Matcher &target);
     bool find_P(PGM_P target);
     bool findUntil(char* target, char* terminator);
+    bool findUntil(Matcher &target, Matcher &terminator);
     bool findUntil_P(PGM_P target, PGM_P terminator);
     int readBytes(char* buffer, size_t length);
     int readBytesUntil(char terminator, char* buffer, size_t length);
     int readBytesUntil(const char* terminator, char* buffer, size_t length);
+    int readBytesUntil(Matcher &terminator, char* buffer, size_t length);
     int readBytesUntil_P(PGM_P terminator, char* buffer, size_t length);
     size_t write_P(PGM_P source);
 //------------------------------------------------------------------------------
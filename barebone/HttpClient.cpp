@@ -19,79 +19,49 @@
  */
 #include <HttpClient.h>
 //------------------------------------------------------------------------------
-/** HTTP GET request format string */
-const char PROGMEM HTTP_REQUEST_GET[] =
-    // command line made of the GET command followed by a URL
-    "GET %s HTTP/1.1\r\n"
-    // domain name of the website
-    "Host: %s\r\n"
-    // user agent used by the device
-    "User-Agent: dsn/1.0\r\n"
-    // the connection to the host can be kept alive between successive requests
-    "Connection: %S\r\n"
-    // HTTP headers end with "\r\n"
-    "\r\n";
-/** HTTP partial GET request format string */
-const char PROGMEM HTTP_REQUEST_PARTIAL_GET[] =
-    // command line made of the GET command followed by a URL
-    "GET %s HTTP/1.1\r\n"
-    // domain name of the website
-    "Host: %s\r\n"
-    // user agent used by the device
-    "User-Agent: dsn/1.0\r\n"
-    // the connection to the host can be kept alive between successive requests
-    "Connection: %S\r\n"
-    // specifying a range allows partial GET requests
-    "Range: bytes=%lu-%lu\r\n"
-    // HTTP headers end with "\r\n"
-    "\r\n";
-/** HTTP HEAD request format string */
-const char PROGMEM HTTP_REQUEST_HEAD[] =
-    // command line made of the GET command followed by a URL
-    "HEAD %s HTTP/1.1\r\n"
-    // domain name of the website
-    "Host: %s\r\n"
-    // user agent used by the device
-    "User-Agent: dsn/1.0\r\n"
-    // the connection to the host can be kept alive between successive requests
-    "Connection: %S\r\n"
-    // HTTP headers end with "\r\n"
-    "\r\n";
-const char PROGMEM HTTP_REQUEST_POST[] =
-    // command line made of the GET command followed by a URL
-    "POST %s HTTP/1.1\r\n"
-    // domain name of the website
-    "Host: %s\r\n"
-    // user agent used by the device
-    "User-Agent: dsn/1.0\r\n"
-    // the connection to the host can be kept alive between successive requests
-    "Connection: %S\r\n"
-    // the length of the content
-    "Content-Length: %d\r\n"
-    // HTTP headers end with "\r\n"
-    "\r\n"
-    // the data to post with the request
-    "%s";
-/** Chunked transfer mode */
-const char PROGMEM HTTP_CHUNKED[] = "Transfer-Encoding: chunked";
+// HTTP request fragments
+/** Command of a GET request, followed by the path */
+const char PROGMEM HTTP_METHOD_GET[] = "GET ";
+/** Command of a HEAD request, followed by the path */
+const char PROGMEM HTTP_METHOD_HEAD[] = "HEAD ";
+/** Command of a POST request, followed by the path */
+const char PROGMEM HTTP_METHOD_POST[] = "POST ";
+/** End of the command line and domain name of the website */
+const char PROGMEM HTTP_HEADER_HOST[] = " HTTP/1.1\r\nHost: ";
+/** User agent used by the device and connection type */
+const char PROGMEM HTTP_HEADER_CONNECTION[] =
+    "\r\nUser-Agent: dsn/1.0\r\nConnection: ";
+/** Range of a partial GET request */
+const char PROGMEM HTTP_HEADER_RANGE[] = "\r\nRange: bytes=";
+/** Length of the content of a POST request */
+const char PROGMEM HTTP_HEADER_CONTENT_LENGTH[] = "\r\nContent-Length: ";
+/** End of the last field and empty line ending the header */
+const char PROGMEM HTTP_HEADER_END[] = "\r\n\r\n";
 /** Regular connection type */
 const char PROGMEM HTTP_FIELD_CLOSE[] = "Close";
-/** Content length field in the HTTP header */
-const char PROGMEM HTTP_CONTENT_LENGTH[] = "Content-Length: ";
-/** End of line */
-const char PROGMEM HTTP_CRLF[] = "\r\n";
-/** End of header */
-const char PROGMEM HTTP_END_OF_HEADER[] = "\r\n\r\n";
 /** Persistent connection type */
 const char PROGMEM HTTP_FIELD_KEEP_ALIVE[] = "Keep-Alive";
-/** Partial content status code */
-const char PROGMEM HTTP_PARTIAL[] = "206 Partial Content";
-/** Size of the temporary buffer used for sscanf() */
-uint8_t const SSCANF_BUFFER_SIZE = 8;
+/** Status code of a successful partial GET request */
+uint16_t const HTTP_STATUS_PARTIAL_CONTENT = 206;
 //------------------------------------------------------------------------------
-/** Open a persistent connection to the host */
+/**
+ * Register header fields whose values must be stored when the next responses
+ * are received.
+ *
+ * \param[in] headers Array of fields to capture, which must remain valid for
+ * as long as requests are sent.
+ * \param[in] count Number of fields in the array.
+ */
+void HttpClient::captureHeaders(HttpHeader* headers, uint8_t count) {
+    response_.captureHeaders(headers, count);
+}
+//------------------------------------------------------------------------------
+/**
+ * Open a persistent connection to the host.
+ *
+ * \note The module is only reset if it cannot reconnect otherwise.
+ */
 bool HttpClient::connect(const char* host) {
-    wifly_->reset();
     return wifly_->connect(host);
 }
 //------------------------------------------------------------------------------
@@ -101,53 +71,69 @@ void HttpClient::disconnect() {
 }
 //------------------------------------------------------------------------------
 /**
- * Create an HTTP request and store it in the provided buffer.
+ * Write the header of a GET or HEAD request straight to the WiFly.
  *
- * \param[out] buffer The buffer where the request will be stored.
- * \param[in] bufferSize The size of the output buffer.
  * \param[in] host The remote host where the resource is located
  * \param[in] path The path of the desired resource on the host.
  * \param[in] flags Flags used to determine the request type and connection
  * mode (see values above).
  * \param[in] firstByte Index of the first byte of the requested range.
  * \param[in] lastByte Index of the last byte of the requested range.
+ *
+ * \return true is returned if the request has been written, false if the
+ * flags are invalid.
+ *
+ * \note Any data left over from a previous response is discarded first,
+ * unless F_PIPELINE is set.
  */
-bool HttpClient::createGetRequest(char* buffer, size_t bufferSize,
-    const char* host, const char* path, uint8_t flags, uint32_t firstByte,
-    uint32_t lastByte) {
+bool HttpClient::emitGetRequest(const char* host, const Printable& path,
+    uint8_t flags, uint32_t firstByte, uint32_t lastByte) {
     // check flags
     if ((flags & F_HEAD) == (flags & F_GET))
         return false;
     else if ((flags & F_KEEP_ALIVE) == (flags & F_CLOSE))
         return false;
-    // determine request type
-    PGM_P request;
-    if (flags & F_HEAD)
-        request = HTTP_REQUEST_HEAD;
-    else if (flags & F_GET) {
-        bool partial = !(firstByte == 0 && lastByte == 0);
-        request = partial ? HTTP_REQUEST_PARTIAL_GET : HTTP_REQUEST_GET;
+    if (!(flags & F_PIPELINE))
+        wifly_->clear();
+    PGM_P method = (flags & F_HEAD) ? HTTP_METHOD_HEAD : HTTP_METHOD_GET;
+    printHeader(*wifly_, method, path, host, flags);
+    if ((flags & F_GET) && !(firstByte == 0 && lastByte == 0)) {
+        wifly_->write_P(HTTP_HEADER_RANGE);
+        wifly_->print(firstByte);
+        wifly_->print('-');
+        wifly_->print(lastByte);
     }
-    // determine connection type
-    bool keepAlive = (flags & F_KEEP_ALIVE);
-    PGM_P connection = keepAlive ? HTTP_FIELD_KEEP_ALIVE : HTTP_FIELD_CLOSE;
-    // print the request to the buffer
-    memset(buffer, 0x00, bufferSize);
-    snprintf_P(
-        buffer,
-        bufferSize,
-        request,
-        path,
-        host,
-        connection,
-        firstByte,
-        lastByte
-    );
+    wifly_->write_P(HTTP_HEADER_END);
     return true;
 }
 //------------------------------------------------------------------------------
-bool HttpClient::createPostRequest(char* buffer, size_t bufferSize,
-    const char* host, const char* path, const char* content, uint8_t flags) {
+/**
+ * Write the header of a GET or HEAD request for a path stored in the RAM.
+ *
+ * \see emitGetRequest(const char*, const Printable&, uint8_t, uint32_t,
+ * uint32_t)
+ */
+bool HttpClient::emitGetRequest(const char* host, const char* path,
+    uint8_t flags, uint32_t firstByte, uint32_t lastByte) {
+    BufferedStream pathString((char*)path);
+    return emitGetRequest(host, pathString, flags, firstByte, lastByte);
+}
+//------------------------------------------------------------------------------
+/**
+ * Write the header of a POST request straight to the WiFly. The body has to
+ * be written afterwards.
+ *
+ * \param[in] host The remote host where the resource is located
+ * \param[in] path The path of the desired resource on the host.
+ * \param[in] length The length of the body.
+ * \param[in] flags Flags used to determine the request type and connection
+ * mode (see values above).
+ *
+ * \return true is returned if the header has been written, false if the
+ * flags are invalid.
+ */
+bool HttpClient::emitPostRequest(const char* host, const Printable& path,
+    uint32_t length, uint8_t flags) {
     // check flags
     if ((flags & F_KEEP_ALIVE) == (flags & F_CLOSE)) {
         return false;
@@ -155,32 +141,47 @@ bool HttpClient::createPostRequest(char* buffer, size_t bufferSize,
     else if ((flags & F_HEAD) == (flags & F_POST)) {
         return false;
     }
-    // determine request type
-    PGM_P request;
-    if (flags & F_HEAD) {
-        request = HTTP_REQUEST_HEAD;
-    }
-    else if (flags & F_POST) {
-        request = HTTP_REQUEST_POST;
-    }
-    // determine connection type
-    bool keepAlive = (flags & F_KEEP_ALIVE);
-    PGM_P connection = keepAlive ? HTTP_FIELD_KEEP_ALIVE : HTTP_FIELD_CLOSE;
-    // print the request to the buffer
-    memset(buffer, 0x00, bufferSize);
-    snprintf_P(
-        buffer,
-        bufferSize,
-        request,
-        path,
-        host,
-        connection,
-        strlen(content),
-        content
-    );
+    if (!(flags & F_PIPELINE))
+        wifly_->clear();
+    PGM_P method = (flags & F_HEAD) ? HTTP_METHOD_HEAD : HTTP_METHOD_POST;
+    printHeader(*wifly_, method, path, host, flags);
+    wifly_->write_P(HTTP_HEADER_CONTENT_LENGTH);
+    wifly_->print(length);
+    wifly_->write_P(HTTP_HEADER_END);
     return true;
 }
 //------------------------------------------------------------------------------
+/**
+ * Write the header of a POST request for a path stored in the RAM.
+ *
+ * \see emitPostRequest(const char*, const Printable&, uint32_t, uint8_t)
+ */
+bool HttpClient::emitPostRequest(const char* host, const char* path,
+    uint32_t length, uint8_t flags) {
+    BufferedStream pathString((char*)path);
+    return emitPostRequest(host, pathString, length, flags);
+}
+//------------------------------------------------------------------------------
+/**
+ * Write the command line and the common fields of a request whose invariant
+ * part has been prepared beforehand.
+ *
+ * \param[in] method The command, followed by a space, in program memory.
+ * \param[in] path The variable beginning of the path.
+ * \param[in] prepared The rest of the command line and the common fields,
+ * see prepareHeader().
+ *
+ * \note The last field is not terminated, so that the caller can append
+ * its own fields before HTTP_HEADER_END.
+ */
+void HttpClient::emitPrepared(PGM_P method, const Printable& path,
+    const char* prepared) {
+    wifly_->clear();
+    wifly_->write_P(method);
+    wifly_->print(path);
+    wifly_->print(prepared);
+}
+//------------------------------------------------------------------------------
 /**
  * Connect to host and send a GET request to retrieve the given URL.
  *
@@ -195,90 +196,100 @@ bool HttpClient::createPostRequest(char* buffer, size_t bufferSize,
  */
 int HttpClient::get(char* buffer, size_t bufferSize, const char* host,
     const char* path) {
+    BufferedStream pathString((char*)path);
+    return get(buffer, bufferSize, host, pathString);
+}
+//------------------------------------------------------------------------------
+/**
+ * Connect to host and send a GET request for a path generated by a
+ * Printable, e.g. an ApiQuery.
+ *
+ * \param[out] buffer The buffer where the response will be written.
+ * \param[in] bufferSize The size of the output buffer.
+ * \param[in] host The remote host where the resource is located.
+ * \param[in] path The path of the desired resource on the host, printed
+ * straight into the request.
+ *
+ * \return The number of bytes actually received, -1 in case of failure.
+ */
+int HttpClient::get(char* buffer, size_t bufferSize, const char* host,
+    const Printable& path) {
     // generate the HTTP request
-    if (!createGetRequest(buffer, bufferSize, host, path,
-        (F_GET | F_KEEP_ALIVE))) {
+    if (!emitGetRequest(host, path, (F_GET | F_KEEP_ALIVE))) {
         return -1;
     }
-
-    // try to send the request and wait for a response from the host
-    wifly_->clear();
-    if (!wifly_->print(buffer))
+    if (!sendRequest())
         return -1;
-    wifly_->flush();
-
-    // clear the buffer since it still holds the HTTP request
-    memset(buffer, 0x00, bufferSize);
-    if (!wifly_->awaitResponse())
+    if (!readHeader())
+        return -1;
+    return readBody(NULL, buffer, bufferSize);
+}
+//------------------------------------------------------------------------------
+/**
+ * Send a GET request and pass the body to a sink as it arrives.
+ *
+ * \param[out] sink The object which will receive the body, e.g. a file.
+ * \param[in] buffer Work buffer used to stage the body.
+ * \param[in] bufferSize The size of the work buffer.
+ * \param[in] host The remote host where the resource is located.
+ * \param[in] path The path of the desired resource on the host.
+ *
+ * \return The number of bytes actually received, -1 in case of failure.
+ *
+ * \note The body may be larger than the buffer: it is handed to the sink at
+ * most one buffer at a time, after chunked transfer decoding.
+ */
+int32_t HttpClient::get(Print& sink, char* buffer, size_t bufferSize,
+    const char* host, const char* path) {
+    if (!emitGetRequest(host, path, (F_GET | F_KEEP_ALIVE))) {
         return -1;
-
-    // determine transfer mode
-    bool chunked = wifly_->findUntil_P(HTTP_CHUNKED, HTTP_END_OF_HEADER);
-    if (chunked) {
-        // skip the rest of the header
-        if (!wifly_->find_P(HTTP_END_OF_HEADER))
-            return -1;
-        // process successive chunks
-        uint16_t index = 0;
-        while (index < bufferSize - 1) {
-            char parseBuffer[SSCANF_BUFFER_SIZE];
-            // read the line containing the chunk size
-            int nBytes = wifly_->readBytesUntil_P(HTTP_CRLF, parseBuffer,
-                SSCANF_BUFFER_SIZE);
-            // chunk size should be at least one digit followed by \r\n
-            if (nBytes < 1 + strlen_P(HTTP_CRLF))
-                return -1;
-            // erase the \r\n
-            memset(parseBuffer + nBytes - 2, 0x00, 2);
-            // parse chunk size
-            uint16_t chunkSize = 0;
-            sscanf(parseBuffer, "%x", &chunkSize);
-            if (chunkSize < 0 || chunkSize > bufferSize) {
-                return -1;
-            }
-            if (chunkSize == 0)
-                break;
-            // download chunk
-            nBytes = wifly_->readBytes(buffer + index, chunkSize);
-            if (nBytes != chunkSize)
-                return -1;
-            index += chunkSize;
-            // skip end of line
-            if (!wifly_->find_P(HTTP_CRLF))
-                return -1;
-        }
-        return index;
-    }
-    else {
-        int nBytes = wifly_->readBytes(buffer, bufferSize);
-        return nBytes;
     }
+    if (!sendRequest())
+        return -1;
+    if (!readHeader())
+        return -1;
+    return readBody(&sink, buffer, bufferSize);
 }
 //------------------------------------------------------------------------------
 /**
  * Send a HEAD request to retrieve the size of the resource located at the
  * given URL.
- * \param[out] buffer The buffer where the response will be written.
- * \param[in] bufferSize The size of the output buffer.
+ * \param[in] buffer Unused, kept for compatibility.
+ * \param[in] bufferSize Unused, kept for compatibility.
  * \param[in] host The remote host where the resource is located.
  * \param[in] path The path of the desired resource on the host.
  */
-uint32_t HttpClient::getContentLength(char* buffer, size_t bufferSize,
-    const char* host, const char* path) {
-    if (!createGetRequest(buffer, bufferSize, host, path,
-        (F_HEAD | F_KEEP_ALIVE)))
-        return 0;
-    wifly_->clear();
-    if (!wifly_->print(buffer))
+uint32_t HttpClient::getContentLength(char*, size_t, const char* host,
+    const char* path) {
+    if (!emitGetRequest(host, path, (F_HEAD | F_KEEP_ALIVE)))
         return 0;
-    wifly_->flush();
-    memset(buffer, 0x00, bufferSize);
-    if (!wifly_->awaitResponse())
+    if (!sendRequest())
         return 0;
-    if (!wifly_->findUntil_P(HTTP_CONTENT_LENGTH, HTTP_END_OF_HEADER))
+    if (!readHeader() || response_.getContentLength() < 0)
         return 0;
-    uint8_t nBytes = wifly_->readBytesUntil_P(HTTP_CRLF, buffer, 32);
-    return atol(buffer);
+    return response_.getContentLength();
+}
+//------------------------------------------------------------------------------
+/**
+ * Send a GET request whose invariant part has been prepared beforehand.
+ *
+ * \param[out] buffer The buffer where the response will be written.
+ * \param[in] bufferSize The size of the output buffer.
+ * \param[in] path The variable beginning of the path.
+ * \param[in] prepared The rest of the command line and the common fields,
+ * see prepareHeader().
+ *
+ * \return The number of bytes actually received, -1 in case of failure.
+ */
+int HttpClient::getPrepared(char* buffer, size_t bufferSize,
+    const Printable& path, const char* prepared) {
+    emitPrepared(HTTP_METHOD_GET, path, prepared);
+    wifly_->write_P(HTTP_HEADER_END);
+    if (!sendRequest())
+        return -1;
+    if (!readHeader())
+        return -1;
+    return readBody(NULL, buffer, bufferSize);
 }
 //------------------------------------------------------------------------------
 /**
@@ -298,33 +309,59 @@ uint32_t HttpClient::getContentLength(char* buffer, size_t bufferSize,
  */
 bool HttpClient::getRange(char* buffer, size_t bufferSize, const char* host,
     const char* path, uint32_t firstByte, uint32_t lastByte) {
+    // the range may be binary, so it does not need a terminator
+    uint32_t length = lastByte - firstByte + 1;
+    if (length > bufferSize)
+        return false;
     // generate the HTTP request
-    if (!createGetRequest(buffer, bufferSize, host, path,
-        (F_GET | F_KEEP_ALIVE), firstByte, lastByte)) {
+    if (!emitGetRequest(host, path, (F_GET | F_KEEP_ALIVE), firstByte, lastByte)) {
         return false;
     }
-
-    // try to send the request and wait for a response from the host
-    wifly_->clear();
-    if (!wifly_->print(buffer))
+    if (!sendRequest())
         return false;
-    wifly_->flush();
-    // clear the buffer since it still holds the HTTP request
-    memset(buffer, 0x00, bufferSize);
-
-    if (!wifly_->awaitResponse())
-        return false;
-
     // look for the right HTTP status code in the response header
-    if (!wifly_->findUntil_P(HTTP_PARTIAL, HTTP_END_OF_HEADER))
+    if (!readHeader())
+        return false;
+    if (response_.getStatusCode() != HTTP_STATUS_PARTIAL_CONTENT)
+        return false;
+    int32_t received = readBody(NULL, buffer, bufferSize, false);
+    if (received < 0)
+        return false;
+    return ((uint32_t)received == length);
+}
+//------------------------------------------------------------------------------
+/**
+ * Send a GET request to retrieve a byte range and pass it to a sink as it
+ * arrives.
+ *
+ * \param[out] sink The object which will receive the data, e.g. a file.
+ * \param[in] buffer Work buffer used to stage the data.
+ * \param[in] bufferSize The size of the work buffer.
+ * \param[in] host The remote host where the resource is located.
+ * \param[in] path The path of the desired resource on the host.
+ * \param[in] firstByte Index of the first byte of the requested range.
+ * \param[in] lastByte Index of the last byte of the requested range.
+ *
+ * \return true is returned if the right amount of data is successfully
+ * received, false in case of failure.
+ */
+bool HttpClient::getRange(Print& sink, char* buffer, size_t bufferSize,
+    const char* host, const char* path, uint32_t firstByte,
+    uint32_t lastByte) {
+    if (!emitGetRequest(host, path, (F_GET | F_KEEP_ALIVE), firstByte, lastByte)) {
+        return false;
+    }
+    if (!sendRequest())
         return false;
-    // skip the rest of the header
-    if (!wifly_->find_P(HTTP_END_OF_HEADER))
+    if (!readHeader())
         return false;
-
-    // write incoming data
-    int nBytes = wifly_->readBytes(buffer, bufferSize);
-    return (nBytes == (lastByte - firstByte + 1));
+    if (response_.getStatusCode() != HTTP_STATUS_PARTIAL_CONTENT)
+        return false;
+    uint32_t length = lastByte - firstByte + 1;
+    int32_t received = readBody(&sink, buffer, bufferSize);
+    if (received < 0)
+        return false;
+    return ((uint32_t)received == length);
 }
 //------------------------------------------------------------------------------
 /**
@@ -334,6 +371,7 @@ bool HttpClient::getRange(char* buffer, size_t bufferSize, const char* host,
  * \param[in] bufferSize The size of the output buffer.
  * \param[in] host The remote host where the resource is located.
  * \param[in] path The path of the desired resource on the host.
+ * \param[in] content The data to post.
  *
  * \return The number of bytes actually received, -1 in case of failure.
  *
@@ -341,27 +379,374 @@ bool HttpClient::getRange(char* buffer, size_t bufferSize, const char* host,
  */
 int HttpClient::post(char* buffer, size_t bufferSize, const char* host,
     const char* path, const char* content) {
-    // generate the HTTP request
-    if (!createPostRequest(buffer, bufferSize, host, path, content,
+    BufferedStream body((char*)content);
+    return post(buffer, bufferSize, host, path, body);
+}
+//------------------------------------------------------------------------------
+/**
+ * Send a POST request with data and pass the response body to a sink as it
+ * arrives.
+ *
+ * \param[out] sink The object which will receive the body.
+ * \param[in] buffer Work buffer used to stage the body.
+ * \param[in] bufferSize The size of the work buffer.
+ * \param[in] host The remote host where the resource is located.
+ * \param[in] path The path of the desired resource on the host.
+ * \param[in] content The data to post.
+ *
+ * \return The number of bytes actually received, -1 in case of failure.
+ */
+int32_t HttpClient::post(Print& sink, char* buffer, size_t bufferSize,
+    const char* host, const char* path, const char* content) {
+    BufferedStream body((char*)content);
+    return post(sink, buffer, bufferSize, host, path, body);
+}
+//------------------------------------------------------------------------------
+/**
+ * Send a POST request whose body is generated by a Printable, e.g. one using
+ * a JsonWriter.
+ *
+ * \param[out] buffer The buffer where the response will be written.
+ * \param[in] bufferSize The size of the output buffer.
+ * \param[in] host The remote host where the resource is located.
+ * \param[in] path The path of the desired resource on the host.
+ * \param[in] content The body, printed once to measure it and once more
+ * straight to the Wifly, so that it is never stored.
+ *
+ * \return The number of bytes actually received, -1 in case of failure.
+ */
+int HttpClient::post(char* buffer, size_t bufferSize, const char* host,
+    const char* path, const Printable& content) {
+    BufferedStream pathString((char*)path);
+    return post(buffer, bufferSize, host, pathString, content);
+}
+//------------------------------------------------------------------------------
+/**
+ * Send a POST request whose path and body are both generated by Printables.
+ *
+ * \param[out] buffer The buffer where the response will be written.
+ * \param[in] bufferSize The size of the output buffer.
+ * \param[in] host The remote host where the resource is located.
+ * \param[in] path The path of the desired resource on the host, printed
+ * straight into the request.
+ * \param[in] content The body, printed once to measure it and once more
+ * straight to the Wifly.
+ *
+ * \return The number of bytes actually received, -1 in case of failure.
+ */
+int HttpClient::post(char* buffer, size_t bufferSize, const char* host,
+    const Printable& path, const Printable& content) {
+    LengthCounter counter;
+    content.printTo(counter);
+    if (!emitPostRequest(host, path, counter.getLength(),
         (F_POST | F_KEEP_ALIVE))) {
         return -1;
     }
-    Serial.println(buffer);
-    // try to send the request and wait for a response from the host
-    wifly_->clear();
-    if (!wifly_->print(buffer))
+    if (!sendRequest(&content))
         return -1;
-    wifly_->flush();
-
-    // clear the buffer since it still holds the HTTP request
-    memset(buffer, 0x00, bufferSize);
-    if (!wifly_->awaitResponse())
+    if (!readHeader())
+        return -1;
+    return readBody(NULL, buffer, bufferSize);
+}
+//------------------------------------------------------------------------------
+/**
+ * Send a POST request whose body is generated by a Printable and pass the
+ * response body to a sink as it arrives.
+ *
+ * \param[out] sink The object which will receive the body.
+ * \param[in] buffer Work buffer used to stage the body.
+ * \param[in] bufferSize The size of the work buffer.
+ * \param[in] host The remote host where the resource is located.
+ * \param[in] path The path of the desired resource on the host.
+ * \param[in] content The body, printed once to measure it and once more
+ * straight to the Wifly.
+ *
+ * \return The number of bytes actually received, -1 in case of failure.
+ */
+int32_t HttpClient::post(Print& sink, char* buffer, size_t bufferSize,
+    const char* host, const char* path, const Printable& content) {
+    LengthCounter counter;
+    content.printTo(counter);
+    if (!emitPostRequest(host, path, counter.getLength(),
+        (F_POST | F_KEEP_ALIVE))) {
+        return -1;
+    }
+    if (!sendRequest(&content))
+        return -1;
+    if (!readHeader())
+        return -1;
+    return readBody(&sink, buffer, bufferSize);
+}
+//------------------------------------------------------------------------------
+/**
+ * Send a POST request whose invariant part has been prepared beforehand.
+ *
+ * \param[out] buffer The buffer where the response will be written.
+ * \param[in] bufferSize The size of the output buffer.
+ * \param[in] path The variable beginning of the path.
+ * \param[in] prepared The rest of the command line and the common fields,
+ * see prepareHeader().
+ * \param[in] content The body, printed once to measure it and once more
+ * straight to the Wifly.
+ *
+ * \return The number of bytes actually received, -1 in case of failure.
+ */
+int HttpClient::postPrepared(char* buffer, size_t bufferSize,
+    const Printable& path, const char* prepared, const Printable& content) {
+    LengthCounter counter;
+    content.printTo(counter);
+    emitPrepared(HTTP_METHOD_POST, path, prepared);
+    wifly_->write_P(HTTP_HEADER_CONTENT_LENGTH);
+    wifly_->print(counter.getLength());
+    wifly_->write_P(HTTP_HEADER_END);
+    if (!sendRequest(&content))
+        return -1;
+    if (!readHeader())
         return -1;
-
-    // skip the headers
-    if (!wifly_->find_P(HTTP_END_OF_HEADER))
+    return readBody(NULL, buffer, bufferSize);
+}
+//------------------------------------------------------------------------------
+/**
+ * Print the part of a request header which follows the path: the end of the
+ * command line and the fields common to every request.
+ *
+ * \param[out] out The Print instance the header is to be printed to.
+ * \param[in] host The remote host where the resource is located.
+ * \param[in] flags Flags used to determine the connection mode.
+ *
+ * \return The number of bytes printed.
+ *
+ * \note The output only depends on the host and the flags, so that it can be
+ * stored once and replayed with getPrepared() and postPrepared().
+ */
+size_t HttpClient::prepareHeader(Print& out, const char* host,
+    uint8_t flags) {
+    bool keepAlive = (flags & F_KEEP_ALIVE);
+    size_t n = out.print((const __FlashStringHelper*)HTTP_HEADER_HOST);
+    n += out.print(host);
+    n += out.print((const __FlashStringHelper*)HTTP_HEADER_CONNECTION);
+    n += out.print((const __FlashStringHelper*)(keepAlive
+        ? HTTP_FIELD_KEEP_ALIVE : HTTP_FIELD_CLOSE));
+    return n;
+}
+//------------------------------------------------------------------------------
+/**
+ * Print the command line and the common fields of a request header.
+ *
+ * \param[out] out The stream where the header is printed.
+ * \param[in] method The command, followed by a space, in program memory.
+ * \param[in] path The path of the desired resource on the host.
+ * \param[in] host The remote host where the resource is located.
+ * \param[in] flags Flags used to determine the connection mode.
+ *
+ * \note The last field is not terminated, so that the caller can append
+ * its own fields before HTTP_HEADER_END.
+ */
+void HttpClient::printHeader(ExtendedStream& out, PGM_P method,
+    const Printable& path, const char* host, uint8_t flags) {
+    out.write_P(method);
+    out.print(path);
+    prepareHeader(out, host, flags);
+}
+//------------------------------------------------------------------------------
+/**
+ * Read the response body, decoding the chunked transfer encoding if needed.
+ *
+ * \param[out] sink The object which will receive the body. If NULL, the body
+ * is kept in the buffer.
+ * \param[out] buffer The buffer where the body is written or staged.
+ * \param[in] bufferSize The size of the buffer.
+ * \param[in] terminate Whether a byte of the buffer is kept for the NUL
+ * terminator when there is no sink.
+ *
+ * \return The number of bytes actually received, -1 in case of failure.
+ *
+ * \note The body is delimited by the chunked encoding or the Content-Length
+ * field when available, so that reading it never has to wait for a timeout.
+ * Without a sink, the body is NUL-terminated and reading stops once
+ * bufferSize - 1 bytes have been kept, or bufferSize bytes if terminate is
+ * false. The rest of the body is then discarded, see keepTruncated().
+ */
+int32_t HttpClient::readBody(Print* sink, char* buffer, size_t bufferSize,
+    bool terminate) {
+    size_t index = 0;
+    if (sink == NULL && bufferSize > 0)
+        buffer[0] = 0x00;
+    uint32_t lastActivity = millis();
+    while (!response_.bodyComplete()) {
+        int nBytes = readBodyBlock(sink, buffer, bufferSize, &index,
+            terminate);
+        if (nBytes < 0)
+            return -1;
+        else if (nBytes > 0)
+            lastActivity = millis();
+        else if (sink == NULL && index + (terminate ? 1 : 0) >= bufferSize)
+            return keepTruncated();
+        else if (response_.endsWithConnection()) {
+            // once the host is gone, only wait for the bytes in transit
+            uint32_t timeout = wifly_->connected() ? HTTP_IDLE_TIMEOUT
+                : HTTP_CLOSE_TIMEOUT;
+            if (millis() - lastActivity > timeout)
+                break;
+        }
+        else if (millis() - lastActivity > HTTP_IDLE_TIMEOUT)
+            return -1;
+    }
+    return response_.getReceived();
+}
+//------------------------------------------------------------------------------
+/**
+ * Discard the body bytes which have already been received, without waiting.
+ *
+ * \return The number of bytes taken from the socket, -1 if the framing is
+ * invalid.
+ */
+int HttpClient::discardBody() {
+    int nBytes = 0;
+    int pending = wifly_->available();
+    while (pending-- > 0 && !response_.bodyComplete()) {
+        int c = wifly_->read();
+        if (c < 0)
+            break;
+        nBytes++;
+        if (response_.getPending() > 0)
+            response_.consume(1);
+        else {
+            response_.frame((char)c);
+            if (response_.bodyFailed())
+                return -1;
+        }
+    }
+    return nBytes;
+}
+//------------------------------------------------------------------------------
+/**
+ * Get rid of the part of the body which does not fit in the buffer, so that
+ * the next response on the connection starts at its status line.
+ *
+ * \return The number of bytes kept in the buffer, -1 if the rest of the body
+ * cannot be discarded.
+ *
+ * \note A body which ends with the connection is cut short by closing the
+ * socket, instead of waiting for the host to close it.
+ */
+int32_t HttpClient::keepTruncated() {
+    int32_t kept = response_.getReceived();
+    if (response_.endsWithConnection()) {
+        disconnect();
+        return kept;
+    }
+    return skipBody() ? kept : -1;
+}
+//------------------------------------------------------------------------------
+/**
+ * Process the body bytes which have already been received, without waiting.
+ *
+ * \param[out] sink The object which will receive the body. If NULL, the body
+ * is kept in the buffer.
+ * \param[out] buffer The buffer where the body is written or staged.
+ * \param[in] bufferSize The size of the buffer.
+ * \param[in,out] index Position of the next byte in the buffer when there is
+ * no sink.
+ * \param[in] terminate Whether the last byte of the buffer is kept for the
+ * NUL terminator when there is no sink.
+ *
+ * \return The number of bytes taken from the socket, 0 if none is available or
+ * the buffer is full, -1 if the body is invalid or the sink fails.
+ *
+ * \note Without a sink, the body is NUL-terminated whenever the buffer has
+ * room left for the terminator.
+ */
+int HttpClient::readBodyBlock(Print* sink, char* buffer, size_t bufferSize,
+    size_t* index, bool terminate) {
+    uint32_t pending = response_.getPending();
+    if (pending == 0) {
+        // chunk sizes and line ends go through the parser
+        int c = wifly_->read();
+        if (c < 0)
+            return 0;
+        response_.frame((char)c);
+        return response_.bodyFailed() ? -1 : 1;
+    }
+    // copy body bytes in blocks
+    size_t room = bufferSize - *index;
+    if (sink == NULL && terminate && room > 0)
+        room--;
+    if (pending < room)
+        room = pending;
+    if (room == 0)
+        return 0;
+    int nBytes = wifly_->readBlock(buffer + *index, room);
+    if (nBytes <= 0)
+        return 0;
+    response_.consume(nBytes);
+    if (sink == NULL) {
+        *index += nBytes;
+        if (*index < bufferSize)
+            buffer[*index] = 0x00;
+    }
+    else if (sink->write((const uint8_t*)buffer, nBytes) != (size_t)nBytes)
         return -1;
-
-    int nBytes = wifly_->readBytes(buffer, bufferSize);
     return nBytes;
 }
+//------------------------------------------------------------------------------
+/**
+ * Discard the rest of a body which does not fit in the buffer.
+ *
+ * \return true is returned once the end of the body is reached, false in case
+ * of timeout or if the framing is invalid.
+ */
+bool HttpClient::skipBody() {
+    uint32_t lastActivity = millis();
+    while (!response_.bodyComplete()) {
+        int nBytes = discardBody();
+        if (nBytes < 0)
+            return false;
+        else if (nBytes > 0)
+            lastActivity = millis();
+        else if (millis() - lastActivity > HTTP_IDLE_TIMEOUT)
+            return false;
+    }
+    return true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Read the response header in a single pass.
+ *
+ * \return true is returned once the end of the header is reached, false is
+ * returned in case of timeout or if the status line is invalid.
+ *
+ * \note The status code and the fields which delimit the body are available
+ * from getResponse() afterwards.
+ */
+bool HttpClient::readHeader() {
+    response_.begin();
+    uint32_t lastActivity = millis();
+    do {
+        int c = wifly_->read();
+        if (c < 0) {
+            if (millis() - lastActivity > HTTP_IDLE_TIMEOUT)
+                return false;
+            continue;
+        }
+        lastActivity = millis();
+        if (response_.feed((char)c))
+            return (response_.getStatusCode() != 0);
+    } while (1);
+}
+//------------------------------------------------------------------------------
+/**
+ * Finish the request which has been written to the WiFly and wait for the
+ * host to respond.
+ *
+ * \param[in] content The body to print after the header, NULL if there is
+ * none.
+ *
+ * \return true if the host responded, false in case of failure.
+ */
+bool HttpClient::sendRequest(const Printable* content) {
+    if (content != NULL)
+        content->printTo(*wifly_);
+    wifly_->flush();
+    return wifly_->awaitResponse();
+}
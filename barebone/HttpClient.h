@@ -24,6 +24,8 @@
  * \brief HttpClient class.
  */
 #include <avr/pgmspace.h>
+#include <BufferedStream.h>
+#include <HttpResponse.h>
 #include <Wifly.h>
 //------------------------------------------------------------------------------
 // HTTP request flags
@@ -37,12 +39,42 @@ uint8_t const F_POST = 0x04;
 uint8_t const F_KEEP_ALIVE = 0x08;
 /** Close the HTTP connection after the request */
 uint8_t const F_CLOSE = 0x10;
+/** Keep the data already received, i.e. responses to pipelined requests */
+uint8_t const F_PIPELINE = 0x20;
+//------------------------------------------------------------------------------
+// Timeouts
+/** Time to wait for more data from the host (in ms) */
+uint32_t const HTTP_IDLE_TIMEOUT = 500;
+/** Time to wait for data still in transit once the host has closed (in ms) */
+uint32_t const HTTP_CLOSE_TIMEOUT = 50;
+//------------------------------------------------------------------------------
+/**
+ * \class LengthCounter
+ * \brief Print which only counts characters, e.g. to compute the
+ * Content-Length of a body before sending it.
+ */
+class LengthCounter : public Print {
+public:
+    /** Construct an instance of LengthCounter. */
+    LengthCounter() : length_(0) {}
+    /** \return The number of characters printed so far. */
+    uint32_t getLength() const {return length_;}
+    /** Count one character. */
+    virtual size_t write(uint8_t) {length_++; return 1;}
+    using Print::write;
+//------------------------------------------------------------------------------
+private:
+    /** Number of characters printed */
+    uint32_t length_;
+};
 //------------------------------------------------------------------------------
 /**
  * \class HttpClient
  * \brief Basic HTTP client.
  */
 class HttpClient {
+    friend class HttpPipeline;
+    friend class HttpRequest;
 public:
     /**
      * Construct an instance of HttpClient.
@@ -50,23 +82,70 @@ public:
      * \param[in] wifly The Wifly object to use for communications.
      */
     explicit HttpClient(Wifly &wifly) : wifly_(&wifly) {}
+    void captureHeaders(HttpHeader* headers, uint8_t count);
     bool connect(const char* host);
     void disconnect();
     int get(char* buffer, size_t bufferSize, const char* host,
         const char* path);
+    int get(char* buffer, size_t bufferSize, const char* host,
+        const Printable& path);
+    int32_t get(Print& sink, char* buffer, size_t bufferSize,
+        const char* host, const char* path);
     uint32_t getContentLength(char* buffer, size_t bufferSize, const char* host,
         const char* path);
+    /**
+     * Get the header of the last response.
+     *
+     * \return The status code and the header fields of the last response.
+     */
+    const HttpResponse& getResponse() const {return response_;}
+    int getPrepared(char* buffer, size_t bufferSize, const Printable& path,
+        const char* prepared);
     bool getRange(char* buffer, size_t bufferSize, const char* host,
         const char* path, uint32_t firstByte, uint32_t lastByte);
+    bool getRange(Print& sink, char* buffer, size_t bufferSize,
+        const char* host, const char* path, uint32_t firstByte,
+        uint32_t lastByte);
     int post(char* buffer, size_t bufferSize, const char* host,
         const char* path, const char* content);
+    int32_t post(Print& sink, char* buffer, size_t bufferSize,
+        const char* host, const char* path, const char* content);
+    int post(char* buffer, size_t bufferSize, const char* host,
+        const char* path, const Printable& content);
+    int32_t post(Print& sink, char* buffer, size_t bufferSize,
+        const char* host, const char* path, const Printable& content);
+    int post(char* buffer, size_t bufferSize, const char* host,
+        const Printable& path, const Printable& content);
+    int postPrepared(char* buffer, size_t bufferSize, const Printable& path,
+        const char* prepared, const Printable& content);
+    static size_t prepareHeader(Print& out, const char* host, uint8_t flags);
 //------------------------------------------------------------------------------
 protected:
-    bool createGetRequest(char* buffer, size_t bufferSize, const char* host,
-        const char* path, uint8_t flags = (F_HEAD | F_CLOSE),
-        uint32_t firstByte = 0, uint32_t lastByte = 0);
-    bool createPostRequest(char* buffer, size_t bufferSize, const char* host,
-        const char* path,  const char* content, uint8_t flags = (F_HEAD | F_CLOSE));
+    bool emitGetRequest(const char* host, const char* path,
+        uint8_t flags = (F_HEAD | F_CLOSE), uint32_t firstByte = 0,
+        uint32_t lastByte = 0);
+    bool emitGetRequest(const char* host, const Printable& path,
+        uint8_t flags = (F_HEAD | F_CLOSE), uint32_t firstByte = 0,
+        uint32_t lastByte = 0);
+    bool emitPostRequest(const char* host, const char* path, uint32_t length,
+        uint8_t flags = (F_HEAD | F_CLOSE));
+    bool emitPostRequest(const char* host, const Printable& path,
+        uint32_t length, uint8_t flags = (F_HEAD | F_CLOSE));
+    void emitPrepared(PGM_P method, const Printable& path,
+        const char* prepared);
+    void printHeader(ExtendedStream& out, PGM_P method, const Printable& path,
+        const char* host, uint8_t flags);
+    int32_t readBody(Print* sink, char* buffer, size_t bufferSize,
+        bool terminate = true);
+    int readBodyBlock(Print* sink, char* buffer, size_t bufferSize,
+        size_t* index, bool terminate = true);
+    int discardBody();
+    int32_t keepTruncated();
+    bool readHeader();
+    bool sendRequest(const Printable* content = NULL);
+    bool skipBody();
+    /** Header of the last response */
+    HttpResponse response_;
     /** WiFly module object */
     Wifly* wifly_;
 };
@@ -0,0 +1,174 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <HttpPipeline.h>
+//------------------------------------------------------------------------------
+/**
+ * Construct an instance of HttpPipeline.
+ *
+ * \param[in] client The HttpClient object to use for communications.
+ */
+HttpPipeline::HttpPipeline(HttpClient &client) :
+    client_(&client),
+    outstanding_(0),
+    broken_(false)
+{
+}
+//------------------------------------------------------------------------------
+/**
+ * Write a GET request without waiting for the responses to the previous ones.
+ *
+ * \param[in] host The remote host where the resource is located.
+ * \param[in] path The path of the desired resource on the host.
+ *
+ * \return true is returned if the request has been written, false if the
+ * pipeline is broken or full.
+ *
+ * \note The socket must already be open, see HttpClient::connect().
+ */
+bool HttpPipeline::get(const char* host, const char* path) {
+    if (broken_ || outstanding_ == HTTP_PIPELINE_DEPTH)
+        return false;
+    if (!client_->emitGetRequest(host, path, (F_GET | queueFlags())))
+        return false;
+    outstanding_++;
+    return true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Read the response to the oldest request.
+ *
+ * \param[out] buffer The buffer where the body will be written.
+ * \param[in] bufferSize The size of the buffer.
+ *
+ * \return The number of body bytes kept in the buffer, -1 if the response
+ * could not be read.
+ *
+ * \note The body is NUL-terminated, the part of it which does not fit in the
+ * buffer is skipped.
+ */
+int32_t HttpPipeline::next(char* buffer, size_t bufferSize) {
+    return readNext(NULL, buffer, bufferSize);
+}
+//------------------------------------------------------------------------------
+/**
+ * Read the response to the oldest request and pass its body to a sink as it
+ * arrives.
+ *
+ * \param[out] sink The object which will receive the body.
+ * \param[in] buffer Work buffer used to stage the body.
+ * \param[in] bufferSize The size of the work buffer.
+ *
+ * \return The number of body bytes received, -1 if the response could not be
+ * read.
+ */
+int32_t HttpPipeline::next(Print& sink, char* buffer, size_t bufferSize) {
+    return readNext(&sink, buffer, bufferSize);
+}
+//------------------------------------------------------------------------------
+/**
+ * Write a POST request without waiting for the responses to the previous
+ * ones.
+ *
+ * \param[in] host The remote host where the resource is located.
+ * \param[in] path The path of the desired resource on the host.
+ * \param[in] content The data to post.
+ *
+ * \return true is returned if the request has been written, false if the
+ * pipeline is broken or full.
+ */
+bool HttpPipeline::post(const char* host, const char* path,
+    const char* content) {
+    BufferedStream body((char*)content);
+    return post(host, path, body);
+}
+//------------------------------------------------------------------------------
+/**
+ * Write a POST request whose body is generated by a Printable without
+ * waiting for the responses to the previous ones.
+ *
+ * \param[in] host The remote host where the resource is located.
+ * \param[in] path The path of the desired resource on the host.
+ * \param[in] content The body, printed once to measure it and once more
+ * straight to the Wifly.
+ *
+ * \return true is returned if the request has been written, false if the
+ * pipeline is broken or full.
+ */
+bool HttpPipeline::post(const char* host, const char* path,
+    const Printable& content) {
+    if (broken_ || outstanding_ == HTTP_PIPELINE_DEPTH)
+        return false;
+    LengthCounter counter;
+    content.printTo(counter);
+    if (!client_->emitPostRequest(host, path, counter.getLength(),
+        (F_POST | queueFlags()))) {
+        return false;
+    }
+    content.printTo(*client_->wifly_);
+    outstanding_++;
+    return true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Determine the connection flags of the next request.
+ *
+ * \return Flags for a persistent connection, which keep the data already
+ * received if other responses are expected.
+ */
+uint8_t HttpPipeline::queueFlags() const {
+    uint8_t flags = F_KEEP_ALIVE;
+    if (outstanding_ > 0)
+        flags |= F_PIPELINE;
+    return flags;
+}
+//------------------------------------------------------------------------------
+/**
+ * Read the response to the oldest request.
+ *
+ * \param[out] sink The object which will receive the body. If NULL, the body
+ * is kept in the buffer.
+ * \param[out] buffer The buffer where the body is written or staged.
+ * \param[in] bufferSize The size of the buffer.
+ *
+ * \return The number of body bytes received, -1 in case of failure.
+ */
+int32_t HttpPipeline::readNext(Print* sink, char* buffer, size_t bufferSize) {
+    if (outstanding_ == 0)
+        return -1;
+    outstanding_--;
+    if (sink == NULL && bufferSize > 0)
+        buffer[0] = 0x00;
+    int32_t length = -1;
+    if (!broken_) {
+        client_->wifly_->flush();
+        if (client_->wifly_->awaitResponse() && client_->readHeader())
+            length = client_->readBody(sink, buffer, bufferSize);
+        const HttpResponse& response = client_->response_;
+        // the next response starts right after the end of this body
+        if (length < 0 || response.endsWithConnection()
+            || !response.isKeepAlive()) {
+            broken_ = true;
+        }
+    }
+    // start afresh once every response has been accounted for
+    if (outstanding_ == 0)
+        broken_ = false;
+    return length;
+}
@@ -0,0 +1,88 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HTTP_PIPELINE_H
+#define HTTP_PIPELINE_H
+/**
+ * \file
+ * \brief HttpPipeline class.
+ */
+#include <HttpClient.h>
+//------------------------------------------------------------------------------
+/**
+ * Maximum number of requests whose response has not been read. The responses
+ * pile up in the RX buffer of the serial port until next() reads them.
+ */
+uint8_t const HTTP_PIPELINE_DEPTH = 4;
+//------------------------------------------------------------------------------
+/**
+ * \class HttpPipeline
+ * \brief HTTP requests written back to back on a persistent connection, whose
+ * responses are then read in the same order.
+ *
+ * The responses are told apart with their Content-Length or chunked framing,
+ * so that N requests cost roughly one round trip instead of N:
+ *
+ * \code
+ * client.connect(host);
+ * pipeline.get(host, path1);
+ * pipeline.post(host, path2, data);
+ * while (pipeline.getOutstanding() > 0) {
+ *     int32_t length = pipeline.next(buffer, sizeof(buffer));
+ *     // a negative length means this response is lost
+ * }
+ * \endcode
+ *
+ * \note Once a response cannot be delimited, e.g. if the host closes the
+ * connection, the responses which follow fail too.
+ *
+ * \note The RX buffer of the serial port only holds 64 bytes, so responses
+ * which arrive while the sketch is not reading are lost unless the module
+ * holds them back. Hardware flow control must be enabled (RTS and CTS wired
+ * and "set uart flow 1") for more than one short response to be outstanding.
+ */
+class HttpPipeline {
+public:
+    explicit HttpPipeline(HttpClient &client);
+    bool get(const char* host, const char* path);
+    /** \return The number of responses which have not been read yet. */
+    uint8_t getOutstanding() const {return outstanding_;}
+    /**
+     * Get the header of the last response read.
+     *
+     * \return The status code and the header fields of the response.
+     */
+    const HttpResponse& getResponse() const {return client_->response_;}
+    int32_t next(char* buffer, size_t bufferSize);
+    int32_t next(Print& sink, char* buffer, size_t bufferSize);
+    bool post(const char* host, const char* path, const char* content);
+    bool post(const char* host, const char* path, const Printable& content);
+//------------------------------------------------------------------------------
+private:
+    uint8_t queueFlags() const;
+    int32_t readNext(Print* sink, char* buffer, size_t bufferSize);
+    /** HTTP client whose connection and response parser are used */
+    HttpClient* client_;
+    /** Number of requests whose response has not been read */
+    uint8_t outstanding_;
+    /** Whether the responses still expected cannot be read anymore */
+    bool broken_;
+};
+
+#endif // HTTP_PIPELINE_H
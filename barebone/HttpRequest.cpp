@@ -0,0 +1,230 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <HttpRequest.h>
+//------------------------------------------------------------------------------
+/**
+ * Construct an instance of HttpRequest.
+ *
+ * \param[in] client The HttpClient object to use for communications.
+ */
+HttpRequest::HttpRequest(HttpClient &client) :
+    client_(&client),
+    sink_(NULL),
+    buffer_(NULL),
+    bufferSize_(0),
+    content_(NULL),
+    contentLength_(0),
+    index_(0),
+    kept_(-1),
+    lastActivity_(0),
+    state_(IDLE)
+{
+}
+//------------------------------------------------------------------------------
+/**
+ * Start a request, which is then carried out by calling poll().
+ *
+ * The header is written to the WiFly right away, whereas the data to post is
+ * written a few bytes at a time by poll().
+ *
+ * \param[out] buffer The buffer where the body will be written.
+ * \param[in] bufferSize The size of the buffer.
+ * \param[in] host The domain name of the host.
+ * \param[in] path The path to the resource on the host.
+ * \param[in] content The data to post, NULL for a GET request. It must remain
+ * valid until the request has been sent.
+ *
+ * \return true is returned if the header has been written, false otherwise.
+ *
+ * \note The socket must already be open, see HttpClient::connect(). Like the
+ * requests of HttpClient, it asks the host to keep the connection open for
+ * the next request.
+ */
+bool HttpRequest::begin(char* buffer, size_t bufferSize, const char* host,
+    const char* path, const char* content) {
+    buffer_ = buffer;
+    bufferSize_ = bufferSize;
+    content_ = content;
+    contentLength_ = (content == NULL) ? 0 : strlen(content);
+    index_ = 0;
+    kept_ = -1;
+    bool emitted;
+    if (content == NULL)
+        emitted = client_->emitGetRequest(host, path, (F_GET | F_KEEP_ALIVE));
+    else
+        emitted = client_->emitPostRequest(host, path, contentLength_,
+            (F_POST | F_KEEP_ALIVE));
+    if (!emitted) {
+        state_ = FAILED;
+        return false;
+    }
+    state_ = SENDING;
+    return true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Get the length of the body.
+ *
+ * \return The number of body bytes received, or kept in the buffer if the
+ * body did not fit, -1 if the request has failed.
+ */
+int32_t HttpRequest::getLength() const {
+    if (state_ == FAILED)
+        return -1;
+    if (kept_ >= 0)
+        return kept_;
+    return client_->response_.getReceived();
+}
+//------------------------------------------------------------------------------
+/**
+ * Advance the request as far as possible without waiting.
+ *
+ * \return true is returned while the request is in progress, false is returned
+ * once it has completed or failed.
+ */
+bool HttpRequest::poll() {
+    switch (state_) {
+        case SENDING :
+            pollSend();
+            break;
+        case AWAITING :
+            if (client_->wifly_->connected() && client_->wifly_->available()) {
+                client_->response_.begin();
+                lastActivity_ = millis();
+                state_ = READING_HEADER;
+            }
+            else if (millis() - lastActivity_ > HTTP_RESPONSE_TIMEOUT)
+                state_ = FAILED;
+            break;
+        case READING_HEADER :
+            pollHeader();
+            break;
+        case READING_BODY :
+            pollBody();
+            break;
+        case SKIPPING_BODY :
+            pollSkip();
+            break;
+        default :
+            break;
+    }
+    return !done();
+}
+//------------------------------------------------------------------------------
+/**
+ * Process the body bytes which have already been received.
+ *
+ * \note At most one buffer worth of data is processed per call so that a fast
+ * host cannot keep the main loop busy.
+ */
+void HttpRequest::pollBody() {
+    HttpResponse& response = client_->response_;
+    size_t budget = bufferSize_;
+    while (!response.bodyComplete()) {
+        int nBytes = client_->readBodyBlock(sink_, buffer_, bufferSize_,
+            &index_);
+        if (nBytes < 0) {
+            state_ = FAILED;
+            return;
+        }
+        else if (nBytes == 0)
+            break;
+        lastActivity_ = millis();
+        if ((size_t)nBytes >= budget)
+            return;
+        budget -= nBytes;
+    }
+    if (response.bodyComplete())
+        state_ = DONE;
+    else if (sink_ == NULL && index_ + 1 >= bufferSize_) {
+        // the rest of the body must leave the socket before the next request
+        kept_ = response.getReceived();
+        if (response.endsWithConnection()) {
+            client_->disconnect();
+            state_ = DONE;
+        }
+        else
+            state_ = SKIPPING_BODY;
+    }
+    else if (response.endsWithConnection()) {
+        // once the host is gone, only wait for the bytes in transit
+        uint32_t timeout = client_->wifly_->connected() ? HTTP_IDLE_TIMEOUT
+            : HTTP_CLOSE_TIMEOUT;
+        if (millis() - lastActivity_ > timeout)
+            state_ = DONE;
+    }
+    else if (millis() - lastActivity_ > HTTP_IDLE_TIMEOUT)
+        state_ = FAILED;
+}
+//------------------------------------------------------------------------------
+/** Feed the header bytes which have already been received to the parser. */
+void HttpRequest::pollHeader() {
+    HttpResponse& response = client_->response_;
+    // the RX buffer bounds the number of bytes handled per call
+    int nBytes = client_->wifly_->available();
+    while (nBytes-- > 0) {
+        int c = client_->wifly_->read();
+        if (c < 0)
+            break;
+        lastActivity_ = millis();
+        if (response.feed((char)c)) {
+            state_ = (response.getStatusCode() != 0) ? READING_BODY : FAILED;
+            if (sink_ == NULL && bufferSize_ > 0)
+                buffer_[0] = 0x00;
+            return;
+        }
+    }
+    if (millis() - lastActivity_ > HTTP_IDLE_TIMEOUT)
+        state_ = FAILED;
+}
+//------------------------------------------------------------------------------
+/** Write the next block of the data to post to the WiFly. */
+void HttpRequest::pollSend() {
+    size_t length = contentLength_ - index_;
+    if (length > HTTP_SEND_BLOCK_SIZE)
+        length = HTTP_SEND_BLOCK_SIZE;
+    if (length > 0 && client_->wifly_->write(
+        (const uint8_t*)content_ + index_, length) != length) {
+        state_ = FAILED;
+        return;
+    }
+    index_ += length;
+    if (index_ < contentLength_)
+        return;
+    index_ = 0;
+    lastActivity_ = millis();
+    state_ = AWAITING;
+}
+//------------------------------------------------------------------------------
+/**
+ * Discard the body bytes which do not fit in the buffer and have already been
+ * received, so that the connection is ready for the next request.
+ */
+void HttpRequest::pollSkip() {
+    int nBytes = client_->discardBody();
+    if (nBytes < 0)
+        state_ = FAILED;
+    else if (client_->response_.bodyComplete())
+        state_ = DONE;
+    else if (nBytes > 0)
+        lastActivity_ = millis();
+    else if (millis() - lastActivity_ > HTTP_IDLE_TIMEOUT)
+        state_ = FAILED;
+}
@@ -0,0 +1,114 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HTTP_REQUEST_H
+#define HTTP_REQUEST_H
+/**
+ * \file
+ * \brief HttpRequest class.
+ */
+#include <HttpClient.h>
+//------------------------------------------------------------------------------
+/** Maximum number of bytes posted to the WiFly per call to poll() */
+uint8_t const HTTP_SEND_BLOCK_SIZE = 16;
+/** Time to wait for the host to respond once the request is sent (in ms) */
+uint32_t const HTTP_RESPONSE_TIMEOUT = 5000;
+//------------------------------------------------------------------------------
+/**
+ * \class HttpRequest
+ * \brief HTTP request performed in small steps from the main loop.
+ *
+ * Each call to poll() only processes what is immediately possible (a few bytes
+ * of the data to post, the bytes already received from the host...) so that
+ * other tasks can be serviced while waiting for the response:
+ *
+ * \code
+ * request.begin(buffer, sizeof(buffer), host, path);
+ * while (request.poll()) {
+ *     // sample sensors, serve the serial port...
+ * }
+ * if (!request.failed())
+ *     // buffer holds request.getLength() bytes of body
+ * \endcode
+ */
+class HttpRequest {
+public:
+    explicit HttpRequest(HttpClient &client);
+    bool begin(char* buffer, size_t bufferSize, const char* host,
+        const char* path, const char* content = NULL);
+    /** \return true once the request has completed or failed. */
+    bool done() const {return state_ == DONE || state_ == FAILED;}
+    /** \return true if the request has failed. */
+    bool failed() const {return state_ == FAILED;}
+    int32_t getLength() const;
+    /**
+     * Get the header of the response.
+     *
+     * \return The status code and the header fields of the response.
+     */
+    const HttpResponse& getResponse() const {return client_->response_;}
+    bool poll();
+    /**
+     * Send the body to an object instead of keeping it in the buffer, which is
+     * then only used to stage blocks of data.
+     *
+     * \param[in] sink The object which will receive the body, NULL to keep the
+     * body in the buffer.
+     */
+    void setSink(Print* sink) {sink_ = sink;}
+//------------------------------------------------------------------------------
+private:
+    /** Phases of the request */
+    enum State {
+        IDLE,
+        SENDING,
+        AWAITING,
+        READING_HEADER,
+        READING_BODY,
+        SKIPPING_BODY,
+        DONE,
+        FAILED
+    };
+    void pollBody();
+    void pollHeader();
+    void pollSend();
+    void pollSkip();
+    /** HTTP client whose connection and response parser are used */
+    HttpClient* client_;
+    /** Object receiving the body, NULL if the body is kept in the buffer */
+    Print* sink_;
+    /** Buffer holding the body */
+    char* buffer_;
+    /** Size of the buffer */
+    size_t bufferSize_;
+    /** Data to post, NULL for a GET request */
+    const char* content_;
+    /** Length of the data to post */
+    size_t contentLength_;
+    /** Position in the data while sending, in the body afterwards */
+    size_t index_;
+    /** Number of body bytes kept when the body is truncated, -1 otherwise */
+    int32_t kept_;
+    /** Time of the last progress (in ms) */
+    uint32_t lastActivity_;
+    /** Current phase */
+    State state_;
+};
+
+#endif // HTTP_REQUEST_H
@@ -0,0 +1,337 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <HttpResponse.h>
+//------------------------------------------------------------------------------
+// Header field names
+/** Connection field */
+const char PROGMEM HTTP_NAME_CONNECTION[] = "Connection";
+/** Content-Length field */
+const char PROGMEM HTTP_NAME_CONTENT_LENGTH[] = "Content-Length";
+/** Content-Range field */
+const char PROGMEM HTTP_NAME_CONTENT_RANGE[] = "Content-Range";
+/** Transfer-Encoding field */
+const char PROGMEM HTTP_NAME_TRANSFER_ENCODING[] = "Transfer-Encoding";
+//------------------------------------------------------------------------------
+// Header field values
+/** Non-persistent connection */
+const char PROGMEM HTTP_VALUE_CLOSE[] = "close";
+/** Persistent connection */
+const char PROGMEM HTTP_VALUE_KEEP_ALIVE[] = "keep-alive";
+/** Chunked transfer coding, which is always the last one applied */
+const char PROGMEM HTTP_VALUE_CHUNKED[] = "chunked";
+//------------------------------------------------------------------------------
+/** Construct an instance of HttpResponse. */
+HttpResponse::HttpResponse() :
+    captures_(NULL),
+    captureCount_(0)
+{
+    begin();
+}
+//------------------------------------------------------------------------------
+/** Forget the previous response and get ready to parse a new header. */
+void HttpResponse::begin() {
+    state_ = STATUS_VERSION;
+    field_ = FIELD_UNKNOWN;
+    capture_ = NULL;
+    length_ = 0;
+    statusCode_ = 0;
+    contentLength_ = -1;
+    chunked_ = false;
+    keepAlive_ = true;
+    rangeFirst_ = 0;
+    rangeLast_ = 0;
+    rangeTotal_ = 0;
+    remaining_ = 0;
+    received_ = 0;
+    for (uint8_t i = 0; i < captureCount_; i++) {
+        if (captures_[i].size > 0)
+            captures_[i].value[0] = 0x00;
+    }
+}
+//------------------------------------------------------------------------------
+/**
+ * Register header fields whose values must be stored while parsing.
+ *
+ * \param[in] headers Array of fields to capture, which must remain valid for
+ * as long as responses are parsed.
+ * \param[in] count Number of fields in the array.
+ *
+ * \note Values longer than the buffer of the field are truncated.
+ */
+void HttpResponse::captureHeaders(HttpHeader* headers, uint8_t count) {
+    captures_ = headers;
+    captureCount_ = count;
+    for (uint8_t i = 0; i < captureCount_; i++) {
+        if (captures_[i].size > 0)
+            captures_[i].value[0] = 0x00;
+    }
+}
+//------------------------------------------------------------------------------
+/**
+ * Acknowledge body bytes which have been copied without going through
+ * frame().
+ *
+ * \param[in] length Number of bytes copied, at most getPending().
+ */
+void HttpResponse::consume(uint32_t length) {
+    received_ += length;
+    if (state_ != BODY_IDENTITY && state_ != CHUNK_DATA)
+        return;
+    remaining_ = (length < remaining_) ? remaining_ - length : 0;
+    if (remaining_ == 0)
+        state_ = (state_ == CHUNK_DATA) ? CHUNK_DATA_END : BODY_COMPLETE;
+}
+//------------------------------------------------------------------------------
+/** Interpret the value of the field which has just been read. */
+void HttpResponse::endField() {
+    // drop trailing white space
+    char* value = (field_ == FIELD_CAPTURED) ? capture_->value : value_;
+    while (length_ > 0 && (value[length_ - 1] == ' '
+        || value[length_ - 1] == '\t')) {
+        value[--length_] = 0x00;
+    }
+    switch (field_) {
+        case FIELD_CONNECTION :
+            if (strcasecmp_P(value_, HTTP_VALUE_CLOSE) == 0)
+                keepAlive_ = false;
+            else if (strcasecmp_P(value_, HTTP_VALUE_KEEP_ALIVE) == 0)
+                keepAlive_ = true;
+            break;
+        case FIELD_CONTENT_LENGTH :
+            contentLength_ = atol(value_);
+            break;
+        case FIELD_CONTENT_RANGE : {
+            // bytes <first>-<last>/<total or *>
+            char* cursor = value_;
+            while (*cursor != 0x00 && (*cursor < '0' || *cursor > '9'))
+                cursor++;
+            rangeFirst_ = strtoul(cursor, &cursor, 10);
+            if (*cursor == '-')
+                rangeLast_ = strtoul(cursor + 1, &cursor, 10);
+            if (*cursor == '/')
+                rangeTotal_ = strtoul(cursor + 1, NULL, 10);
+            break;
+        }
+        case FIELD_TRANSFER_ENCODING : {
+            uint8_t chunkedLength = strlen_P(HTTP_VALUE_CHUNKED);
+            chunked_ = (length_ >= chunkedLength && strcasecmp_P(
+                value_ + length_ - chunkedLength, HTTP_VALUE_CHUNKED) == 0);
+            break;
+        }
+        default :
+            break;
+    }
+    field_ = FIELD_UNKNOWN;
+    capture_ = NULL;
+}
+//------------------------------------------------------------------------------
+/**
+ * Parse one character of the response header.
+ *
+ * \param[in] c The next character received from the host.
+ *
+ * \return true is returned once the end of the header has been reached.
+ */
+bool HttpResponse::feed(char c) {
+    // lines are delimited by the line feed alone
+    if (c == '\r')
+        return headerComplete();
+    switch (state_) {
+        case STATUS_VERSION :
+            // HTTP/1.0 connections are not persistent by default
+            if (c == ' ') {
+                keepAlive_ = (name_[0] != '0');
+                state_ = STATUS_CODE;
+            }
+            else if (c == '\n')
+                state_ = FIELD_NAME;
+            else
+                name_[0] = c;
+            break;
+        case STATUS_CODE :
+            if (c >= '0' && c <= '9')
+                statusCode_ = 10 * statusCode_ + (c - '0');
+            else if (c == '\n')
+                state_ = FIELD_NAME;
+            else
+                state_ = STATUS_REASON;
+            break;
+        case STATUS_REASON :
+            if (c == '\n')
+                state_ = FIELD_NAME;
+            break;
+        case FIELD_NAME :
+            if (c == '\n') {
+                // an empty line ends the header
+                if (length_ == 0)
+                    startBody();
+                length_ = 0;
+            }
+            else if (c == ':') {
+                selectField();
+                length_ = 0;
+                state_ = FIELD_VALUE;
+            }
+            else if (length_ < HTTP_NAME_BUFFER_SIZE - 1)
+                name_[length_++] = c;
+            else
+                // the name is too long to be one of the expected fields
+                length_ = HTTP_NAME_BUFFER_SIZE;
+            break;
+        case FIELD_VALUE :
+            if (c == '\n') {
+                endField();
+                length_ = 0;
+                state_ = FIELD_NAME;
+            }
+            else if (length_ == 0 && (c == ' ' || c == '\t'))
+                break;
+            else if (field_ == FIELD_CAPTURED) {
+                if (length_ + 1 < capture_->size) {
+                    capture_->value[length_++] = c;
+                    capture_->value[length_] = 0x00;
+                }
+            }
+            else if (field_ != FIELD_UNKNOWN) {
+                if (length_ + 1 < HTTP_VALUE_BUFFER_SIZE) {
+                    value_[length_++] = c;
+                    value_[length_] = 0x00;
+                }
+            }
+            break;
+        default :
+            break;
+    }
+    return headerComplete();
+}
+//------------------------------------------------------------------------------
+/**
+ * Parse one byte of body framing, i.e. a byte received while getPending()
+ * returns 0.
+ *
+ * \param[in] c The next character received from the host.
+ */
+void HttpResponse::frame(char c) {
+    switch (state_) {
+        case CHUNK_SIZE :
+            if (c >= '0' && c <= '9')
+                remaining_ = (remaining_ << 4) | (c - '0');
+            else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+                remaining_ = (remaining_ << 4) | ((c | 0x20) - 'a' + 10);
+            else if (c == ';' || c == ' ')
+                state_ = CHUNK_EXTENSION;
+            else if (c == '\n')
+                state_ = (remaining_ == 0) ? CHUNK_TRAILER : CHUNK_DATA;
+            else if (c != '\r')
+                state_ = BODY_ERROR;
+            length_ = 0;
+            break;
+        case CHUNK_EXTENSION :
+            if (c == '\n')
+                state_ = (remaining_ == 0) ? CHUNK_TRAILER : CHUNK_DATA;
+            break;
+        case CHUNK_DATA_END :
+            if (c == '\n')
+                state_ = CHUNK_SIZE;
+            else if (c != '\r')
+                state_ = BODY_ERROR;
+            break;
+        case CHUNK_TRAILER :
+            // the trailer ends with an empty line
+            if (c == '\n') {
+                if (length_ == 0)
+                    state_ = BODY_COMPLETE;
+                length_ = 0;
+            }
+            else if (c != '\r')
+                length_ = 1;
+            break;
+        default :
+            break;
+    }
+}
+//------------------------------------------------------------------------------
+/**
+ * Get the number of body bytes which can be copied as is.
+ *
+ * \return The number of bytes left in the current chunk or in the body. 0 is
+ * returned if the next byte belongs to the framing. 0xFFFFFFFF is returned
+ * if the body ends with the connection.
+ */
+uint32_t HttpResponse::getPending() const {
+    if (state_ == BODY_IDENTITY || state_ == CHUNK_DATA)
+        return remaining_;
+    else if (state_ == BODY_UNTIL_CLOSE)
+        return 0xFFFFFFFF;
+    else
+        return 0;
+}
+//------------------------------------------------------------------------------
+/** Identify the field whose name has just been read. */
+void HttpResponse::selectField() {
+    field_ = FIELD_UNKNOWN;
+    capture_ = NULL;
+    value_[0] = 0x00;
+    if (length_ >= HTTP_NAME_BUFFER_SIZE)
+        return;
+    name_[length_] = 0x00;
+    if (strcasecmp_P(name_, HTTP_NAME_CONTENT_LENGTH) == 0)
+        field_ = FIELD_CONTENT_LENGTH;
+    else if (strcasecmp_P(name_, HTTP_NAME_TRANSFER_ENCODING) == 0)
+        field_ = FIELD_TRANSFER_ENCODING;
+    else if (strcasecmp_P(name_, HTTP_NAME_CONNECTION) == 0)
+        field_ = FIELD_CONNECTION;
+    else if (strcasecmp_P(name_, HTTP_NAME_CONTENT_RANGE) == 0)
+        field_ = FIELD_CONTENT_RANGE;
+    else {
+        for (uint8_t i = 0; i < captureCount_; i++) {
+            if (captures_[i].size > 0
+                && strcasecmp_P(name_, captures_[i].name) == 0) {
+                field_ = FIELD_CAPTURED;
+                capture_ = &captures_[i];
+                capture_->value[0] = 0x00;
+                break;
+            }
+        }
+    }
+}
+//------------------------------------------------------------------------------
+/** Determine how the body is delimited once the header is complete. */
+void HttpResponse::startBody() {
+    // interim responses, e.g. 100 Continue, are followed by the final one
+    if (statusCode_ >= 100 && statusCode_ < 200 && statusCode_ != 101) {
+        begin();
+        return;
+    }
+    remaining_ = 0;
+    // 101 Switching Protocols, 204 No Content and 304 Not Modified have no body
+    if (statusCode_ < 200 || statusCode_ == 204 || statusCode_ == 304)
+        state_ = BODY_COMPLETE;
+    else if (chunked_)
+        state_ = CHUNK_SIZE;
+    else if (contentLength_ < 0)
+        state_ = BODY_UNTIL_CLOSE;
+    else if (contentLength_ == 0)
+        state_ = BODY_COMPLETE;
+    else {
+        remaining_ = contentLength_;
+        state_ = BODY_IDENTITY;
+    }
+}
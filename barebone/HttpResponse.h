@@ -0,0 +1,167 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HTTP_RESPONSE_H
+#define HTTP_RESPONSE_H
+/**
+ * \file
+ * \brief HttpResponse class.
+ */
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+//------------------------------------------------------------------------------
+/** Size of the buffer holding the name of the current header field */
+uint8_t const HTTP_NAME_BUFFER_SIZE = 20;
+/** Size of the buffer holding the value of a standard header field */
+uint8_t const HTTP_VALUE_BUFFER_SIZE = 40;
+//------------------------------------------------------------------------------
+/**
+ * \struct HttpHeader
+ * \brief Header field whose value is captured on behalf of the caller.
+ */
+struct HttpHeader {
+    /** Name of the field in program memory (case insensitive) */
+    PGM_P name;
+    /** Buffer where the null-terminated value will be written */
+    char* value;
+    /** Size of the value buffer */
+    uint8_t size;
+};
+//------------------------------------------------------------------------------
+/**
+ * \class HttpResponse
+ * \brief Streaming parser for the header and the framing of an HTTP response.
+ *
+ * Characters are fed one at a time as they arrive, so the header is read
+ * exactly once whatever the number of fields the caller is interested in.
+ * Once the header is complete, getPending() tells how many body bytes may be
+ * copied verbatim, and any other byte has to be passed to frame() so that
+ * chunked bodies are decoded on the fly. Interim 1xx responses are skipped,
+ * only the final response is reported.
+ */
+class HttpResponse {
+public:
+    HttpResponse();
+    void begin();
+    /** \return true once the whole body has been received. */
+    bool bodyComplete() const {return state_ == BODY_COMPLETE;}
+    /** \return true if the body framing is invalid. */
+    bool bodyFailed() const {return state_ == BODY_ERROR;}
+    void captureHeaders(HttpHeader* headers, uint8_t count);
+    void consume(uint32_t length);
+    /**
+     * Check whether the end of the body is signaled by closing the connection.
+     *
+     * \return true is returned if the body is neither chunked nor of known
+     * length.
+     */
+    bool endsWithConnection() const {return state_ == BODY_UNTIL_CLOSE;}
+    bool feed(char c);
+    void frame(char c);
+    /**
+     * Get the length of the body.
+     *
+     * \return The value of the Content-Length field, -1 if it is missing.
+     */
+    int32_t getContentLength() const {return contentLength_;}
+    uint32_t getPending() const;
+    /** \return The number of body bytes received so far. */
+    uint32_t getReceived() const {return received_;}
+    /** \return The first byte of the range given by Content-Range. */
+    uint32_t getRangeFirst() const {return rangeFirst_;}
+    /** \return The last byte of the range given by Content-Range. */
+    uint32_t getRangeLast() const {return rangeLast_;}
+    /** \return The complete length given by Content-Range, 0 if unknown. */
+    uint32_t getRangeTotal() const {return rangeTotal_;}
+    /** \return The status code, 0 if the status line was not understood. */
+    uint16_t getStatusCode() const {return statusCode_;}
+    /** \return true once the empty line ending the header has been read. */
+    bool headerComplete() const {return state_ >= BODY_IDENTITY;}
+    /** \return true if the body uses chunked transfer encoding. */
+    bool isChunked() const {return chunked_;}
+    /** \return true if the host will keep the connection open. */
+    bool isKeepAlive() const {return keepAlive_;}
+//------------------------------------------------------------------------------
+private:
+    /** States of the header parser */
+    enum State {
+        STATUS_VERSION,
+        STATUS_CODE,
+        STATUS_REASON,
+        FIELD_NAME,
+        FIELD_VALUE,
+        BODY_IDENTITY,
+        BODY_UNTIL_CLOSE,
+        CHUNK_SIZE,
+        CHUNK_EXTENSION,
+        CHUNK_DATA,
+        CHUNK_DATA_END,
+        CHUNK_TRAILER,
+        BODY_COMPLETE,
+        BODY_ERROR
+    };
+    /** Fields which are needed to handle the response */
+    enum Field {
+        FIELD_UNKNOWN,
+        FIELD_CONNECTION,
+        FIELD_CONTENT_LENGTH,
+        FIELD_CONTENT_RANGE,
+        FIELD_TRANSFER_ENCODING,
+        FIELD_CAPTURED
+    };
+    void endField();
+    void selectField();
+    void startBody();
+    /** Current state of the parser */
+    State state_;
+    /** Field currently being parsed */
+    uint8_t field_;
+    /** Caller's header being captured when field_ is FIELD_CAPTURED */
+    HttpHeader* capture_;
+    /** Number of characters in name_ or in the current value */
+    uint8_t length_;
+    /** Name of the current field */
+    char name_[HTTP_NAME_BUFFER_SIZE];
+    /** Value of the current standard field */
+    char value_[HTTP_VALUE_BUFFER_SIZE];
+    /** Headers the caller wants to capture */
+    HttpHeader* captures_;
+    /** Number of headers to capture */
+    uint8_t captureCount_;
+    /** Status code */
+    uint16_t statusCode_;
+    /** Length of the body, -1 if unknown */
+    int32_t contentLength_;
+    /** Whether the body is chunked */
+    bool chunked_;
+    /** Whether the connection is persistent */
+    bool keepAlive_;
+    /** First byte of the partial content */
+    uint32_t rangeFirst_;
+    /** Last byte of the partial content */
+    uint32_t rangeLast_;
+    /** Complete length of the resource */
+    uint32_t rangeTotal_;
+    /** Body bytes left in the current chunk or in the whole body */
+    uint32_t remaining_;
+    /** Body bytes received so far */
+    uint32_t received_;
+};
+
+#endif // HTTP_RESPONSE_H
@@ -0,0 +1,71 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <JsonCursor.h>
+//------------------------------------------------------------------------------
+/**
+ * Position the cursor on the first element of an array.
+ *
+ * \param[in] stream The stream holding the array.
+ * \param[in] offset The position of the opening bracket.
+ */
+void JsonCursor::begin(const JsonStream* stream, uint16_t offset) {
+    stream_ = stream;
+    offset_ = stream->skipSpace(offset + 1);
+    if (stream->atEnd(offset_) || stream->buffer_[offset_] == ']')
+        stream_ = NULL;
+}
+//------------------------------------------------------------------------------
+/**
+ * Get the next element of the array without copying it.
+ *
+ * \param[out] view The location of the element in the buffer. Strings are
+ * given without their quotes and escape sequences are left as is, other
+ * values as they appear in the document.
+ *
+ * \return The type of the element, i.e. JSON_OBJECT, JSON_ARRAY, JSON_STRING
+ * or JSON_PRIMITIVE, 0 once every element has been returned or if the array
+ * is malformed.
+ */
+uint8_t JsonCursor::next(JsonView* view) {
+    if (stream_ == NULL)
+        return 0;
+    uint16_t start = offset_;
+    uint16_t end = stream_->skipValue(start);
+    if (end == start) {
+        stream_ = NULL;
+        return 0;
+    }
+    uint8_t type = JsonStream::typeOf(stream_->buffer_[start]);
+    if (type == JSON_STRING && end - start >= 2) {
+        view->ptr = stream_->buffer_ + start + 1;
+        view->len = end - start - 2;
+    }
+    else {
+        view->ptr = stream_->buffer_ + start;
+        view->len = end - start;
+    }
+    // move to the following element, if any
+    uint16_t i = stream_->skipSpace(end);
+    if (!stream_->atEnd(i) && stream_->buffer_[i] == ',')
+        offset_ = stream_->skipSpace(i + 1);
+    else
+        stream_ = NULL;
+    return type;
+}
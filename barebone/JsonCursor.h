@@ -0,0 +1,64 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef JSON_CURSOR_H
+#define JSON_CURSOR_H
+/**
+ * \file
+ * \brief JsonCursor class.
+ */
+#include <JsonStream.h>
+//------------------------------------------------------------------------------
+/**
+ * \class JsonCursor
+ * \brief Iterator over the elements of a JSON array held by a JsonStream.
+ *
+ * Each call to next() resumes where the previous one stopped, so the array is
+ * walked once and its elements are never copied. An element which is itself
+ * an object or an array can be queried by constructing a JsonStream on its
+ * view, e.g. to process a batch of commands:
+ *
+ * \code
+ * JsonCursor commands;
+ * JsonView command;
+ * json.getArrayByName_P(KEY_COMMANDS, &commands);
+ * while (commands.next(&command) == JSON_OBJECT) {
+ *     JsonStream element(command);
+ *     element.getStringByName_P(KEY_TYPE, type, sizeof(type));
+ * }
+ * \endcode
+ */
+class JsonCursor {
+public:
+    /** Construct an instance of JsonCursor with no element to return. */
+    JsonCursor() : stream_(NULL), offset_(0) {}
+    /** \return true once every element has been returned. */
+    bool done() const {return stream_ == NULL;}
+    uint8_t next(JsonView* view);
+//------------------------------------------------------------------------------
+private:
+    friend class JsonStream;
+    void begin(const JsonStream* stream, uint16_t offset);
+    /** Stream holding the array, NULL once the array has been walked */
+    const JsonStream* stream_;
+    /** Position of the next element */
+    uint16_t offset_;
+};
+
+#endif // JSON_CURSOR_H
@@ -0,0 +1,168 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <JsonDecoder.h>
+//------------------------------------------------------------------------------
+/** Characters following a backslash, each one followed by its meaning */
+const char PROGMEM JSON_ESCAPES[] = "\"\"\\\\//b\bf\fn\nr\rt\t";
+/** Code point replacing malformed sequences */
+uint16_t const JSON_REPLACEMENT = 0xFFFD;
+//------------------------------------------------------------------------------
+/**
+ * Write a code point in UTF-8.
+ *
+ * \param[in] code The code point, surrogates being replaced with U+FFFD.
+ * \param[out] out The location of the bytes, 4 at most.
+ *
+ * \return The number of bytes written.
+ */
+uint8_t JsonDecoder::encode(uint32_t code, char* out) {
+    if (code >= 0xD800 && code <= 0xDFFF)
+        code = JSON_REPLACEMENT;
+    if (code < 0x80) {
+        out[0] = code;
+        return 1;
+    }
+    else if (code < 0x800) {
+        out[0] = 0xC0 | (code >> 6);
+        out[1] = 0x80 | (code & 0x3F);
+        return 2;
+    }
+    else if (code < 0x10000) {
+        out[0] = 0xE0 | (code >> 12);
+        out[1] = 0x80 | ((code >> 6) & 0x3F);
+        out[2] = 0x80 | (code & 0x3F);
+        return 3;
+    }
+    out[0] = 0xF0 | (code >> 18);
+    out[1] = 0x80 | ((code >> 12) & 0x3F);
+    out[2] = 0x80 | ((code >> 6) & 0x3F);
+    out[3] = 0x80 | (code & 0x3F);
+    return 4;
+}
+//------------------------------------------------------------------------------
+/**
+ * Decode one character of a string, quotes excluded.
+ *
+ * \param[in] c The next character of the string as it appears in the document.
+ * \param[out] out The location of the decoded bytes, at least
+ * JSON_DECODED_SIZE bytes long.
+ *
+ * \return The number of bytes written, 0 while an escape sequence is
+ * incomplete.
+ *
+ * \note Decoding never produces more bytes than it consumes before the end of
+ * the string, so it can be done in place.
+ */
+uint8_t JsonDecoder::feed(char c, char* out) {
+    if (state_ == TEXT) {
+        if (c != '\\') {
+            out[0] = c;
+            return 1;
+        }
+        state_ = ESCAPE;
+        return 0;
+    }
+    uint8_t n;
+    switch (state_) {
+        case ESCAPE :
+            if (c == 'u') {
+                code_ = 0;
+                digits_ = 4;
+                state_ = HEX;
+                return 0;
+            }
+            state_ = TEXT;
+            // unknown escapes stand for the character itself
+            out[0] = c;
+            for (PGM_P p = JSON_ESCAPES; pgm_read_byte(p) != 0x00; p += 2) {
+                if (pgm_read_byte(p) == c) {
+                    out[0] = pgm_read_byte(p + 1);
+                    break;
+                }
+            }
+            return 1;
+        case HEX :
+        case LOW_HEX :
+            if (c >= '0' && c <= '9')
+                c -= '0';
+            else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+                c = (c | 0x20) - 'a' + 10;
+            else {
+                state_ = TEXT;
+                return encode(JSON_REPLACEMENT, out);
+            }
+            code_ = (code_ << 4) | c;
+            if (--digits_ > 0)
+                return 0;
+            if (state_ == HEX && code_ >= 0xD800 && code_ <= 0xDBFF) {
+                high_ = code_;
+                state_ = LOW_BACKSLASH;
+                return 0;
+            }
+            else if (state_ == HEX) {
+                state_ = TEXT;
+                return encode(code_, out);
+            }
+            state_ = TEXT;
+            if (code_ >= 0xDC00 && code_ <= 0xDFFF) {
+                return encode(0x10000 + ((uint32_t)(high_ - 0xD800) << 10)
+                    + (code_ - 0xDC00), out);
+            }
+            n = encode(JSON_REPLACEMENT, out);
+            return n + encode(code_, out + n);
+        case LOW_BACKSLASH :
+            if (c == '\\') {
+                state_ = LOW_U;
+                return 0;
+            }
+            // the high surrogate is alone
+            state_ = TEXT;
+            n = encode(JSON_REPLACEMENT, out);
+            return n + feed(c, out + n);
+        case LOW_U :
+            if (c == 'u') {
+                code_ = 0;
+                digits_ = 4;
+                state_ = LOW_HEX;
+                return 0;
+            }
+            state_ = ESCAPE;
+            n = encode(JSON_REPLACEMENT, out);
+            return n + feed(c, out + n);
+        default :
+            state_ = TEXT;
+            return 0;
+    }
+}
+//------------------------------------------------------------------------------
+/**
+ * Terminate the string.
+ *
+ * \param[out] out The location of the bytes standing for an incomplete escape
+ * sequence, at least JSON_DECODED_SIZE bytes long.
+ *
+ * \return The number of bytes written.
+ */
+uint8_t JsonDecoder::finish(char* out) {
+    if (state_ == TEXT)
+        return 0;
+    state_ = TEXT;
+    return encode(JSON_REPLACEMENT, out);
+}
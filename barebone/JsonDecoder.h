@@ -0,0 +1,78 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef JSON_DECODER_H
+#define JSON_DECODER_H
+/**
+ * \file
+ * \brief JsonDecoder class.
+ */
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+//------------------------------------------------------------------------------
+/** Largest number of bytes produced by a single character fed to the decoder */
+uint8_t const JSON_DECODED_SIZE = 6;
+//------------------------------------------------------------------------------
+/**
+ * \class JsonDecoder
+ * \brief State machine turning the escaped characters of a JSON string into
+ * UTF-8, one character at a time.
+ *
+ * All the escape sequences are supported, including \\uXXXX and surrogate
+ * pairs. Malformed sequences and lone surrogates are replaced with U+FFFD.
+ * Characters outside escape sequences cost a single comparison.
+ */
+class JsonDecoder {
+public:
+    /** Construct an instance of JsonDecoder. */
+    JsonDecoder() : state_(TEXT) {}
+    uint8_t feed(char c, char* out);
+    uint8_t finish(char* out);
+    /**
+     * Check whether the last character fed is part of an escape sequence, in
+     * which case the next one cannot end the string.
+     *
+     * \return true is returned if an escape sequence is incomplete.
+     */
+    bool inEscape() const {return state_ != TEXT && state_ != LOW_BACKSLASH;}
+    /** Forget any incomplete escape sequence. */
+    void reset() {state_ = TEXT;}
+//------------------------------------------------------------------------------
+private:
+    /** States of the decoder */
+    enum State {
+        TEXT,
+        ESCAPE,
+        HEX,
+        LOW_BACKSLASH,
+        LOW_U,
+        LOW_HEX
+    };
+    static uint8_t encode(uint32_t code, char* out);
+    /** Current state of the decoder */
+    uint8_t state_;
+    /** Number of hexadecimal digits left in the current \\u sequence */
+    uint8_t digits_;
+    /** Code unit of the current \\u sequence */
+    uint16_t code_;
+    /** High surrogate waiting for its low surrogate */
+    uint16_t high_;
+};
+
+#endif // JSON_DECODER_H
@@ -0,0 +1,343 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <JsonParser.h>
+//------------------------------------------------------------------------------
+/** Characters which end a number or a literal */
+const char PROGMEM JSON_PARSER_DELIMITERS[] = ",]} \t\r\n";
+/** Characters which may start a number or a literal */
+const char PROGMEM JSON_PARSER_LITERAL_START[] = "-0123456789tfn";
+//------------------------------------------------------------------------------
+/** Construct an instance of JsonParser. */
+JsonParser::JsonParser() :
+    listener_(NULL),
+    subscriptions_(NULL),
+    subscriptionCount_(0)
+{
+    begin();
+}
+//------------------------------------------------------------------------------
+/**
+ * Append the index of the current array element to the path.
+ *
+ * \return true is returned if the path buffer is large enough.
+ */
+bool JsonParser::appendIndex() {
+    truncatePath();
+    char digits[6];
+    utoa(elements_[depth_ - 1], digits, 10);
+    if (!appendPath('['))
+        return false;
+    for (uint8_t i = 0; digits[i] != 0x00; i++) {
+        if (!appendPath(digits[i]))
+            return false;
+    }
+    return appendPath(']');
+}
+//------------------------------------------------------------------------------
+/**
+ * Append a character to the path.
+ *
+ * \param[in] c The character to append.
+ *
+ * \return true is returned if the path buffer is large enough.
+ */
+bool JsonParser::appendPath(char c) {
+    if (pathLength_ + 1 >= JSON_PATH_SIZE)
+        return false;
+    path_[pathLength_++] = c;
+    path_[pathLength_] = 0x00;
+    return true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Append a character to the current value, dropping it if the buffer is full.
+ *
+ * \param[in] c The character to append.
+ */
+void JsonParser::appendValue(char c) {
+    if (listener_ != NULL && valueLength_ + 1 < JSON_VALUE_SIZE) {
+        value_[valueLength_++] = c;
+        value_[valueLength_] = 0x00;
+    }
+    if (active_ != NULL && activeLength_ + 1 < active_->size) {
+        active_->value[activeLength_++] = c;
+        active_->value[activeLength_] = 0x00;
+    }
+}
+//------------------------------------------------------------------------------
+/** Forget the previous document and get ready to parse a new one. */
+void JsonParser::begin() {
+    state_ = VALUE;
+    decoder_.reset();
+    depth_ = 0;
+    objects_ = 0;
+    path_[0] = 0x00;
+    pathLength_ = 0;
+    value_[0] = 0x00;
+    valueLength_ = 0;
+    active_ = NULL;
+    for (uint8_t i = 0; i < subscriptionCount_; i++) {
+        if (subscriptions_[i].size > 0)
+            subscriptions_[i].value[0] = 0x00;
+    }
+}
+//------------------------------------------------------------------------------
+/** Start the path of an object member, whose key follows. */
+void JsonParser::beginMember() {
+    truncatePath();
+    if (pathLength_ > 0 && !appendPath('.'))
+        state_ = FAILED;
+    else
+        state_ = KEY;
+}
+//------------------------------------------------------------------------------
+/**
+ * Close the innermost container.
+ *
+ * \param[in] type The type given by the closing character.
+ */
+void JsonParser::closeContainer(uint8_t type) {
+    if (depth_ == 0 || inObject() != (type == JSON_OBJECT)) {
+        state_ = FAILED;
+        return;
+    }
+    depth_--;
+    pathLength_ = pathLengths_[depth_];
+    path_[pathLength_] = 0x00;
+    if (listener_ != NULL)
+        listener_->onEnd(path_, type);
+    state_ = (depth_ == 0) ? DONE : AFTER_VALUE;
+}
+//------------------------------------------------------------------------------
+/**
+ * Report the string or literal which has just ended.
+ *
+ * \param[in] type JSON_STRING or JSON_PRIMITIVE.
+ */
+void JsonParser::endValue(uint8_t type) {
+    if (listener_ != NULL)
+        listener_->onValue(path_, type, value_);
+    active_ = NULL;
+    state_ = (depth_ == 0) ? DONE : AFTER_VALUE;
+}
+//------------------------------------------------------------------------------
+/**
+ * Open an object or an array.
+ *
+ * \param[in] type JSON_OBJECT or JSON_ARRAY.
+ */
+void JsonParser::openContainer(uint8_t type) {
+    if (depth_ == JSON_MAX_DEPTH) {
+        state_ = FAILED;
+        return;
+    }
+    if (listener_ != NULL)
+        listener_->onStart(path_, type);
+    pathLengths_[depth_] = pathLength_;
+    elements_[depth_] = 0;
+    if (type == JSON_OBJECT)
+        objects_ |= (1 << depth_);
+    else
+        objects_ &= ~(1 << depth_);
+    depth_++;
+    state_ = (type == JSON_OBJECT) ? FIRST_KEY : FIRST_VALUE;
+}
+//------------------------------------------------------------------------------
+/**
+ * Parse a document read from a stream.
+ *
+ * \param[in] stream The stream to read from, e.g. a Wifly socket.
+ *
+ * \return true is returned if the whole document has been parsed, false is
+ * returned if it is malformed or if the stream times out.
+ *
+ * \note Bytes are taken from the stream in blocks, so a few bytes following
+ * the document may be consumed as well.
+ */
+bool JsonParser::parse(ExtendedStream &stream) {
+    char buffer[JSON_PARSE_BLOCK_SIZE];
+    while (state_ != DONE && state_ != FAILED) {
+        int nBytes = stream.readBlock(buffer, JSON_PARSE_BLOCK_SIZE);
+        // wait for more data within the timeout of the stream
+        if (nBytes <= 0)
+            nBytes = stream.readBytes(buffer, 1);
+        if (nBytes <= 0)
+            return false;
+        for (int i = 0; i < nBytes; i++)
+            write(buffer[i]);
+    }
+    return done();
+}
+//------------------------------------------------------------------------------
+/**
+ * Start a value within the current container.
+ *
+ * \param[in] c The first character of the value.
+ *
+ * \note Only the first character of numbers and literals is checked, the
+ * rest of them is reported as is.
+ */
+void JsonParser::startValue(char c) {
+    if (c != '"' && c != '{' && c != '['
+        && strchr_P(JSON_PARSER_LITERAL_START, c) == NULL) {
+        state_ = FAILED;
+        return;
+    }
+    if (depth_ > 0 && !inObject() && !appendIndex()) {
+        state_ = FAILED;
+        return;
+    }
+    if (c == '{' || c == '[') {
+        openContainer((c == '{') ? JSON_OBJECT : JSON_ARRAY);
+        return;
+    }
+    valueLength_ = 0;
+    value_[0] = 0x00;
+    for (uint8_t i = 0; i < subscriptionCount_; i++) {
+        if (subscriptions_[i].size > 0
+            && strcmp_P(path_, subscriptions_[i].path) == 0) {
+            active_ = &subscriptions_[i];
+            activeLength_ = 0;
+            active_->value[0] = 0x00;
+            break;
+        }
+    }
+    if (c == '"')
+        state_ = STRING;
+    else {
+        appendValue(c);
+        state_ = LITERAL;
+    }
+}
+//------------------------------------------------------------------------------
+/**
+ * Register values which must be stored when the next documents are parsed.
+ *
+ * \param[in] subscriptions Array of values to capture, which must remain valid
+ * for as long as documents are parsed.
+ * \param[in] count Number of values in the array.
+ *
+ * \note Only strings, numbers and literals can be captured. Values longer than
+ * the buffer of the subscription are truncated.
+ */
+void JsonParser::subscribe(JsonSubscription* subscriptions, uint8_t count) {
+    subscriptions_ = subscriptions;
+    subscriptionCount_ = count;
+    for (uint8_t i = 0; i < subscriptionCount_; i++) {
+        if (subscriptions_[i].size > 0)
+            subscriptions_[i].value[0] = 0x00;
+    }
+}
+//------------------------------------------------------------------------------
+/** Go back to the path of the innermost container. */
+void JsonParser::truncatePath() {
+    pathLength_ = pathLengths_[depth_ - 1];
+    path_[pathLength_] = 0x00;
+}
+//------------------------------------------------------------------------------
+/**
+ * Parse one character of the document.
+ *
+ * \param[in] c The next character of the document.
+ *
+ * \return 1 is returned, 0 is returned once the document is known to be
+ * malformed.
+ */
+size_t JsonParser::write(uint8_t c) {
+    switch (state_) {
+        case KEY :
+        case STRING : {
+            char bytes[JSON_DECODED_SIZE];
+            bool end = (c == '"' && !decoder_.inEscape());
+            uint8_t n = end ? decoder_.finish(bytes) : decoder_.feed(c, bytes);
+            for (uint8_t i = 0; i < n; i++) {
+                if (state_ == STRING)
+                    appendValue(bytes[i]);
+                else if (!appendPath(bytes[i]))
+                    state_ = FAILED;
+            }
+            if (state_ == FAILED)
+                return 0;
+            if (end && state_ == KEY)
+                state_ = COLON;
+            else if (end)
+                endValue(JSON_STRING);
+            return 1;
+        }
+        case LITERAL :
+            if (strchr_P(JSON_PARSER_DELIMITERS, c) == NULL) {
+                appendValue(c);
+                return 1;
+            }
+            // the delimiter is handled below
+            endValue(JSON_PRIMITIVE);
+            break;
+        default :
+            break;
+    }
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+        return 1;
+    switch (state_) {
+        case FIRST_KEY :
+            if (c == '}') {
+                closeContainer(JSON_OBJECT);
+                break;
+            }
+            // no break
+        case NEXT_KEY :
+            if (c == '"')
+                beginMember();
+            else
+                state_ = FAILED;
+            break;
+        case COLON :
+            state_ = (c == ':') ? VALUE : FAILED;
+            break;
+        case FIRST_VALUE :
+            if (c == ']') {
+                closeContainer(JSON_ARRAY);
+                break;
+            }
+            // no break
+        case VALUE :
+            startValue(c);
+            break;
+        case AFTER_VALUE :
+            if (c == ',') {
+                if (inObject())
+                    state_ = NEXT_KEY;
+                else {
+                    elements_[depth_ - 1]++;
+                    state_ = VALUE;
+                }
+            }
+            else if (c == '}')
+                closeContainer(JSON_OBJECT);
+            else if (c == ']')
+                closeContainer(JSON_ARRAY);
+            else
+                state_ = FAILED;
+            break;
+        default :
+            // anything following the document is ignored
+            break;
+    }
+    return (state_ == FAILED) ? 0 : 1;
+}
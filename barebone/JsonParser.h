@@ -0,0 +1,175 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef JSON_PARSER_H
+#define JSON_PARSER_H
+/**
+ * \file
+ * \brief JsonParser class.
+ */
+#include <JsonStream.h>
+//------------------------------------------------------------------------------
+/** Maximum nesting level of objects and arrays (16 at most) */
+uint8_t const JSON_MAX_DEPTH = 8;
+/** Size of the buffer holding the path of the current value */
+uint8_t const JSON_PATH_SIZE = 48;
+/** Size of the buffer holding the current value for the listener */
+uint8_t const JSON_VALUE_SIZE = 32;
+/** Number of bytes taken from the stream at once by parse() */
+uint8_t const JSON_PARSE_BLOCK_SIZE = 16;
+//------------------------------------------------------------------------------
+/**
+ * \struct JsonSubscription
+ * \brief Value captured on behalf of the caller while the document streams
+ * past.
+ */
+struct JsonSubscription {
+    /** Path of the value in program memory, e.g. "data.sensors[2].value" */
+    PGM_P path;
+    /** Buffer where the null-terminated value will be written */
+    char* value;
+    /** Size of the value buffer */
+    uint8_t size;
+};
+//------------------------------------------------------------------------------
+/**
+ * \class JsonListener
+ * \brief Receives the events of a JsonParser.
+ *
+ * Paths use dots between keys and brackets around array indices, the root
+ * element having an empty path.
+ */
+class JsonListener {
+public:
+    /**
+     * Called when an object or an array starts.
+     *
+     * \param[in] path The path of the container.
+     * \param[in] type JSON_OBJECT or JSON_ARRAY.
+     */
+    virtual void onStart(const char*, uint8_t) {}
+    /**
+     * Called when an object or an array ends.
+     *
+     * \param[in] path The path of the container.
+     * \param[in] type JSON_OBJECT or JSON_ARRAY.
+     */
+    virtual void onEnd(const char*, uint8_t) {}
+    /**
+     * Called for each string, number and literal.
+     *
+     * \param[in] path The path of the value.
+     * \param[in] type JSON_STRING or JSON_PRIMITIVE.
+     * \param[in] value The unescaped value, truncated to JSON_VALUE_SIZE - 1
+     * characters.
+     */
+    virtual void onValue(const char* path, uint8_t type, const char* value) = 0;
+};
+//------------------------------------------------------------------------------
+/**
+ * \class JsonParser
+ * \brief Event-based JSON parser fed one character at a time.
+ *
+ * The document never has to be stored: characters are either written to the
+ * parser like to any Print object (e.g. as the sink of HttpClient::get()) or
+ * pulled from a stream by parse(). Values are reported to a listener and/or
+ * copied to the subscriptions whose path matches.
+ *
+ * A number or a literal at the root of the document only ends with the
+ * whitespace which follows it, so such a document is not done() until a
+ * space or a line end has been written after it.
+ */
+class JsonParser : public Print {
+public:
+    JsonParser();
+    void begin();
+    /** \return true once the root element has been parsed. */
+    bool done() const {return state_ == DONE;}
+    /** \return true if the document is malformed or too deeply nested. */
+    bool failed() const {return state_ == FAILED;}
+    bool parse(ExtendedStream &stream);
+    /**
+     * Set the object receiving the parsing events.
+     *
+     * \param[in] listener The listener, NULL to stop reporting events.
+     */
+    void setListener(JsonListener* listener) {listener_ = listener;}
+    void subscribe(JsonSubscription* subscriptions, uint8_t count);
+    virtual size_t write(uint8_t c);
+    using Print::write;
+//------------------------------------------------------------------------------
+private:
+    /** States of the parser */
+    enum State {
+        VALUE,
+        FIRST_VALUE,
+        FIRST_KEY,
+        NEXT_KEY,
+        KEY,
+        COLON,
+        STRING,
+        LITERAL,
+        AFTER_VALUE,
+        DONE,
+        FAILED
+    };
+    bool appendIndex();
+    bool appendPath(char c);
+    void appendValue(char c);
+    void beginMember();
+    void closeContainer(uint8_t type);
+    void endValue(uint8_t type);
+    /** \return true if the innermost container is an object. */
+    bool inObject() const {return objects_ & (1 << (depth_ - 1));}
+    void openContainer(uint8_t type);
+    void startValue(char c);
+    void truncatePath();
+    /** Object receiving the events */
+    JsonListener* listener_;
+    /** Values the caller wants to capture */
+    JsonSubscription* subscriptions_;
+    /** Number of subscriptions */
+    uint8_t subscriptionCount_;
+    /** Subscription matching the current value */
+    JsonSubscription* active_;
+    /** Number of characters written to the active subscription */
+    uint8_t activeLength_;
+    /** Current state */
+    State state_;
+    /** Decoder of the escape sequences of the current string */
+    JsonDecoder decoder_;
+    /** Number of open containers */
+    uint8_t depth_;
+    /** One bit per open container, set for objects */
+    uint16_t objects_;
+    /** Index of the current element of each open array */
+    uint16_t elements_[JSON_MAX_DEPTH];
+    /** Length of the path of each open container */
+    uint8_t pathLengths_[JSON_MAX_DEPTH];
+    /** Path of the current value */
+    char path_[JSON_PATH_SIZE];
+    /** Length of the path */
+    uint8_t pathLength_;
+    /** Current value */
+    char value_[JSON_VALUE_SIZE];
+    /** Length of the current value */
+    uint8_t valueLength_;
+};
+
+#endif // JSON_PARSER_H
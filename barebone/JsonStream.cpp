@@ -18,9 +18,379 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include <JsonStream.h>
+#include <JsonCursor.h>
 //------------------------------------------------------------------------------
-/** Size of the temporary buffer used for sscanf() */
-const char ATOI_BUFFER_SIZE = 16;
+/** Characters which end a number or a literal */
+const char PROGMEM JSON_DELIMITERS[] = ",:]} \t\r\n";
+/** Literal true */
+const char PROGMEM JSON_TRUE[] = "true";
+/** Literal false */
+const char PROGMEM JSON_FALSE[] = "false";
+/** Literal null */
+const char PROGMEM JSON_NULL[] = "null";
+//------------------------------------------------------------------------------
+/**
+ * Copy an indexed string.
+ *
+ * \param[in] token The string token.
+ * \param[out] buffer Target buffer to write the value.
+ * \param[in] length Maximum length to write to the buffer.
+ *
+ * \return The number of characters written to the buffer is returned.
+ */
+int JsonStream::copyString(const JsonToken &token, char* buffer,
+    size_t length) const {
+    uint16_t nChars = token.end - token.start;
+    if (!(token.type & JSON_DECODED))
+        return decode(buffer_ + token.start, nChars, buffer, length);
+    if (length == 0)
+        return 0;
+    if (nChars > length - 1)
+        nChars = length - 1;
+    memcpy(buffer, buffer_ + token.start, nChars);
+    buffer[nChars] = 0x00;
+    return nChars;
+}
+//------------------------------------------------------------------------------
+/**
+ * Decode the escape sequences of a string into UTF-8.
+ *
+ * \param[in] source The escaped characters, without the quotes.
+ * \param[in] length The number of escaped characters.
+ * \param[out] destination The location the null-terminated string will be
+ * written to, which may be the source itself.
+ * \param[in] capacity The size of the destination.
+ *
+ * \return The number of bytes written, not counting the null terminator.
+ *
+ * \note Multibyte characters which do not fit are dropped as a whole.
+ */
+uint16_t JsonStream::decode(const char* source, uint16_t length,
+    char* destination, uint16_t capacity) {
+    if (capacity == 0)
+        return 0;
+    JsonDecoder decoder;
+    char bytes[JSON_DECODED_SIZE];
+    uint16_t nChars = 0;
+    for (uint16_t i = 0; i < length; i++) {
+        uint8_t n = decoder.feed(source[i], bytes);
+        if (i + 1 == length)
+            n += decoder.finish(bytes + n);
+        if (nChars + n > capacity - 1)
+            break;
+        memcpy(destination + nChars, bytes, n);
+        nChars += n;
+    }
+    destination[nChars] = 0x00;
+    return nChars;
+}
+//------------------------------------------------------------------------------
+/**
+ * Check whether getViewByName() has decoded strings in place.
+ *
+ * \return true is returned if the buffer no longer holds the raw document.
+ */
+bool JsonStream::decoded() const {
+    for (uint8_t i = 0; i < tokenCount_; i++) {
+        if (tokens_[i].type & JSON_DECODED)
+            return true;
+    }
+    return false;
+}
+//------------------------------------------------------------------------------
+/**
+ * Store the value of a member in a field of the target structure.
+ *
+ * \param[in] field The description of the field.
+ * \param[in] offset The position of the value in the buffer.
+ * \param[out] target The structure holding the field.
+ *
+ * \return true is returned if the value has the type of the field.
+ */
+bool JsonStream::extractField(const JsonField &field, uint16_t offset,
+    uint8_t* target) {
+    void* destination = target + field.offset;
+    uint16_t length = skipValue(offset) - offset;
+    switch (field.type) {
+        case JSON_FIELD_STRING :
+            return (getString(offset, (char*)destination, field.capacity) >= 0);
+        case JSON_FIELD_INT32 : {
+            int32_t value;
+            if (parseInt32(offset, 0, true, &value) != JSON_OK)
+                return false;
+            memcpy(destination, &value, sizeof(value));
+            return true;
+        }
+        case JSON_FIELD_BOOL : {
+            bool value;
+            if (keyEquals(offset, length, JSON_TRUE, true))
+                value = true;
+            else if (keyEquals(offset, length, JSON_FALSE, true))
+                value = false;
+            else
+                return false;
+            memcpy(destination, &value, sizeof(value));
+            return true;
+        }
+        case JSON_FIELD_OBJECT :
+            if (buffer_[offset] != '{' || field.capacity == 0)
+                return false;
+            if (length >= field.capacity)
+                length = field.capacity - 1;
+            memcpy(destination, buffer_ + offset, length);
+            ((char*)destination)[length] = 0x00;
+            return true;
+        default :
+            return false;
+    }
+}
+//------------------------------------------------------------------------------
+/**
+ * Fill several fields of a structure with the members of the root object in a
+ * single pass over the document.
+ *
+ * \param[in] fields Table of fields in program memory.
+ * \param[in] count Number of fields in the table.
+ * \param[out] target The structure to fill.
+ *
+ * \return The number of fields found with the expected type.
+ *
+ * \note Strings and objects which are not found are left empty, while other
+ * fields keep their previous value.
+ */
+uint8_t JsonStream::extract_P(const JsonField* fields, uint8_t count,
+    void* target) {
+    uint8_t* base = (uint8_t*)target;
+    JsonField field;
+    for (uint8_t f = 0; f < count; f++) {
+        memcpy_P(&field, &fields[f], sizeof(JsonField));
+        if ((field.type == JSON_FIELD_STRING
+            || field.type == JSON_FIELD_OBJECT) && field.capacity > 0)
+            base[field.offset] = 0x00;
+    }
+    uint8_t found = 0;
+    uint16_t i = skipSpace(0);
+    if (atEnd(i) || buffer_[i] != '{')
+        return 0;
+    i++;
+    do {
+        i = skipSpace(i);
+        if (!atEnd(i) && buffer_[i] == ',')
+            i = skipSpace(i + 1);
+        if (atEnd(i) || buffer_[i] != '"')
+            break;
+        // read the key
+        uint16_t key = i + 1;
+        i = skipValue(i);
+        uint16_t keyLength = i - 1 - key;
+        i = skipSpace(i);
+        if (atEnd(i) || buffer_[i] != ':')
+            break;
+        i = skipSpace(i + 1);
+        // store the value if the key is in the table
+        for (uint8_t f = 0; f < count; f++) {
+            memcpy_P(&field, &fields[f], sizeof(JsonField));
+            if (keyEquals(key, keyLength, field.key, true)) {
+                if (extractField(field, i, base))
+                    found++;
+                break;
+            }
+        }
+        i = skipValue(i);
+    } while (1);
+    return found;
+}
+//------------------------------------------------------------------------------
+/**
+ * Look up the value of a key using the index.
+ *
+ * \param[in] key The key to look for.
+ * \param[in] progmem Whether the key resides in program memory.
+ * \param[in] type The expected type of the value, 0 for any type.
+ *
+ * \return The position of the value token, -1 if the key is not found or if
+ * the value has another type.
+ */
+int16_t JsonStream::findValue(const char* key, bool progmem,
+    uint8_t type) const {
+    for (uint8_t i = 0; i + 1 < tokenCount_; i++) {
+        // only the members of the root object are looked up
+        if (tokens_[i].type != JSON_KEY || tokens_[i].depth != 1
+            || !keyEquals(tokens_[i].start, tokens_[i].end - tokens_[i].start,
+            key, progmem))
+            continue;
+        if (type != 0 && (tokens_[i + 1].type & ~JSON_DECODED) != type)
+            return -1;
+        return i + 1;
+    }
+    return -1;
+}
+//------------------------------------------------------------------------------
+/**
+ * Find the provided key string and position a cursor on the first element of
+ * the associated array.
+ *
+ * \param[in] key Key string to find.
+ * \param[out] cursor The cursor to position.
+ *
+ * \return true is returned if the key is found and its value is an array.
+ */
+bool JsonStream::getArrayByName(const char* key, JsonCursor* cursor) {
+    uint16_t offset;
+    if (!seekValue(key, false, JSON_ARRAY, &offset))
+        return false;
+    cursor->begin(this, offset);
+    return true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Like getArrayByName() but with a key located in the program memory.
+ *
+ * \param[in] key Key string to find.
+ * \param[out] cursor The cursor to position.
+ *
+ * \return true is returned if the key is found and its value is an array.
+ */
+bool JsonStream::getArrayByName_P(PGM_P key, JsonCursor* cursor) {
+    uint16_t offset;
+    if (!seekValue(key, true, JSON_ARRAY, &offset))
+        return false;
+    cursor->begin(this, offset);
+    return true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Position a cursor on the first element of the array found at the end of a
+ * path.
+ *
+ * \param[in] path Keys separated by dots, array indices between brackets. An
+ * empty path designates the document itself.
+ * \param[out] cursor The cursor to position.
+ *
+ * \return true is returned if the path leads to an array.
+ */
+bool JsonStream::getArrayByPath(const char* path, JsonCursor* cursor) {
+    uint16_t offset;
+    if (!seekPath(path, false, &offset) || buffer_[offset] != '[')
+        return false;
+    cursor->begin(this, offset);
+    return true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Like getArrayByPath() but with a path located in the program memory.
+ *
+ * \param[in] path Keys separated by dots, array indices between brackets.
+ * \param[out] cursor The cursor to position.
+ *
+ * \return true is returned if the path leads to an array.
+ */
+bool JsonStream::getArrayByPath_P(PGM_P path, JsonCursor* cursor) {
+    uint16_t offset;
+    if (!seekPath(path, true, &offset) || buffer_[offset] != '[')
+        return false;
+    cursor->begin(this, offset);
+    return true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Parse the boolean value corresponding to the key string provided.
+ *
+ * \param[in] key Key string to find.
+ * \param[out] value The location to store the value, left untouched unless
+ * JSON_OK is returned.
+ *
+ * \return JSON_OK, JSON_NOT_FOUND or JSON_TYPE_MISMATCH.
+ */
+uint8_t JsonStream::getBoolByName(const char* key, bool* value) {
+    return parseBool(key, false, value);
+}
+//------------------------------------------------------------------------------
+/**
+ * Like getBoolByName() but with a key located in the program memory.
+ *
+ * \param[in] key Key string to find.
+ * \param[out] value The location to store the value.
+ *
+ * \return JSON_OK, JSON_NOT_FOUND or JSON_TYPE_MISMATCH.
+ */
+uint8_t JsonStream::getBoolByName_P(PGM_P key, bool* value) {
+    return parseBool(key, true, value);
+}
+//------------------------------------------------------------------------------
+/**
+ * Parse the decimal number corresponding to the key string provided as a
+ * fixed-point integer, e.g. 21.5 is stored as 2150 with 2 decimals.
+ *
+ * \param[in] key Key string to find.
+ * \param[in] decimals The number of digits to keep after the decimal point,
+ * further digits are truncated.
+ * \param[out] value The location to store the scaled value, left untouched
+ * unless JSON_OK is returned.
+ *
+ * \return JSON_OK, JSON_NOT_FOUND, JSON_TYPE_MISMATCH or JSON_OVERFLOW.
+ */
+uint8_t JsonStream::getDecimalByName(const char* key, uint8_t decimals,
+    int32_t* value) {
+    return parseInt32(key, false, decimals, false, value);
+}
+//------------------------------------------------------------------------------
+/**
+ * Like getDecimalByName() but with a key located in the program memory.
+ *
+ * \param[in] key Key string to find.
+ * \param[in] decimals The number of digits to keep after the decimal point.
+ * \param[out] value The location to store the scaled value.
+ *
+ * \return JSON_OK, JSON_NOT_FOUND, JSON_TYPE_MISMATCH or JSON_OVERFLOW.
+ */
+uint8_t JsonStream::getDecimalByName_P(PGM_P key, uint8_t decimals,
+    int32_t* value) {
+    return parseInt32(key, true, decimals, false, value);
+}
+//------------------------------------------------------------------------------
+/**
+ * Parse the signed integer corresponding to the key string provided.
+ *
+ * \param[in] key Key string to find.
+ * \param[out] value The location to store the value, left untouched unless
+ * JSON_OK is returned.
+ *
+ * \return JSON_OK, JSON_NOT_FOUND, JSON_TYPE_MISMATCH if the value is not an
+ * integer or JSON_OVERFLOW.
+ */
+uint8_t JsonStream::getInt32ByName(const char* key, int32_t* value) {
+    return parseInt32(key, false, 0, true, value);
+}
+//------------------------------------------------------------------------------
+/**
+ * Like getInt32ByName() but with a key located in the program memory.
+ *
+ * \param[in] key Key string to find.
+ * \param[out] value The location to store the value.
+ *
+ * \return JSON_OK, JSON_NOT_FOUND, JSON_TYPE_MISMATCH or JSON_OVERFLOW.
+ */
+uint8_t JsonStream::getInt32ByName_P(PGM_P key, int32_t* value) {
+    return parseInt32(key, true, 0, true, value);
+}
+//------------------------------------------------------------------------------
+/**
+ * Parse the integer found at a given position.
+ *
+ * \param[in] offset The position of the first character of the value.
+ *
+ * \return The integer, -1 if the value is not an integer or does not fit in
+ * an int.
+ */
+int JsonStream::getInteger(uint16_t offset) const {
+    int32_t value;
+    if (parseInt32(offset, 0, true, &value) != JSON_OK)
+        return -1;
+    if ((int32_t)(int)value != value)
+        return -1;
+    return (int)value;
+}
 //------------------------------------------------------------------------------
 /**
  * Parse the integer value corresponding to the key string provided.
@@ -31,14 +401,10 @@ const char ATOI_BUFFER_SIZE = 16;
  * this integer is returned.
  */
 int JsonStream::getIntegerByName(const char* key) {
-    rewind();
-    if (!find(key))
+    uint16_t offset;
+    if (!seekValue(key, false, JSON_PRIMITIVE, &offset))
         return -1;
-    if (!find(':'))
-        return -1;
-    char buffer[ATOI_BUFFER_SIZE];
-    readBytesUntil('}', buffer, ATOI_BUFFER_SIZE);
-    return atoi(buffer);
+    return getInteger(offset);
 }
 //------------------------------------------------------------------------------
 /**
@@ -50,20 +416,94 @@ int JsonStream::getIntegerByName(const char* key) {
  * this integer is returned.
  */
 int JsonStream::getIntegerByName_P(PGM_P key) {
-    rewind();
-    if (!find_P(key))
+    uint16_t offset;
+    if (!seekValue(key, true, JSON_PRIMITIVE, &offset))
+        return -1;
+    return getInteger(offset);
+}
+//------------------------------------------------------------------------------
+/**
+ * Parse the integer found at the end of a path, e.g. "data.sensors[2].value".
+ *
+ * \param[in] path Keys separated by dots, array indices between brackets.
+ *
+ * \return If the path leads to an integer, this integer is returned, -1
+ * otherwise.
+ */
+int JsonStream::getIntegerByPath(const char* path) {
+    uint16_t offset;
+    if (!seekPath(path, false, &offset))
+        return -1;
+    return getInteger(offset);
+}
+//------------------------------------------------------------------------------
+/**
+ * Like getIntegerByPath() but with a path located in the program memory.
+ *
+ * \param[in] path Keys separated by dots, array indices between brackets.
+ *
+ * \return If the path leads to an integer, this integer is returned, -1
+ * otherwise.
+ */
+int JsonStream::getIntegerByPath_P(PGM_P path) {
+    uint16_t offset;
+    if (!seekPath(path, true, &offset))
         return -1;
-    if (!find(':'))
+    return getInteger(offset);
+}
+//------------------------------------------------------------------------------
+/**
+ * Check whether the value corresponding to the key string provided is null.
+ *
+ * \param[in] key Key string to find.
+ *
+ * \return JSON_OK if the value is null, JSON_NOT_FOUND or JSON_TYPE_MISMATCH
+ * otherwise.
+ */
+uint8_t JsonStream::getNullByName(const char* key) {
+    return parseNull(key, false);
+}
+//------------------------------------------------------------------------------
+/**
+ * Like getNullByName() but with a key located in the program memory.
+ *
+ * \param[in] key Key string to find.
+ *
+ * \return JSON_OK if the value is null, JSON_NOT_FOUND or JSON_TYPE_MISMATCH
+ * otherwise.
+ */
+uint8_t JsonStream::getNullByName_P(PGM_P key) {
+    return parseNull(key, true);
+}
+//------------------------------------------------------------------------------
+/**
+ * Copy the members of the object found at a given position.
+ *
+ * \param[in] offset The position of the opening brace.
+ * \param[out] buffer Target buffer to write the members.
+ * \param[in] length Maximum length to write to the buffer.
+ *
+ * \return The number of characters written to the buffer, -1 if the value is
+ * not an object.
+ */
+int JsonStream::getObjectString(uint16_t offset, char* buffer, size_t length)
+    const {
+    if (buffer_[offset] != '{' || length == 0)
+        return -1;
+    uint16_t end = skipValue(offset);
+    if (buffer_[end - 1] != '}')
         return -1;
-    char buffer[ATOI_BUFFER_SIZE];
-    readBytesUntil('}', buffer, ATOI_BUFFER_SIZE);
-    return atoi(buffer);
+    uint16_t nChars = end - offset - 2;
+    if (nChars > length - 1)
+        nChars = length - 1;
+    memcpy(buffer, buffer_ + offset + 1, nChars);
+    buffer[nChars] = 0x00;
+    return nChars;
 }
 //------------------------------------------------------------------------------
 /**
  * Find the provided key string and write the associated object string to the
- * target buffer. This functions allows one leve of depth in the supported JSON
- * strings.
+ * target buffer, without the enclosing braces.
  *
  * \param[in] key Key string to find.
  * \param[out] buffer Target buffer to write the value.
@@ -72,19 +512,14 @@ int JsonStream::getIntegerByName_P(PGM_P key) {
  * \return The number of characters written to the buffer is returned.
  */
 int JsonStream::getObjectStringByName(const char* key, char* buffer, size_t length) {
-    rewind();
-    if (!find(key))
+    uint16_t offset;
+    if (!seekValue(key, false, JSON_OBJECT, &offset))
         return -1;
-    if (!find(':'))
-        return -1;
-     if (!find('{'))
-        return -1;
-    return readBytesUntil('}', buffer, length);
+    return getObjectString(offset, buffer, length);
 }//------------------------------------------------------------------------------
 /**
  * Find the provided key string and write the associated object string to the
- * target buffer. This functions allows one leve of depth in the supported JSON
- * strings.
+ * target buffer, without the enclosing braces.
  *
  * \param[in] key Key string to find.
  * \param[out] buffer Target buffer to write the value.
@@ -93,14 +528,29 @@ int JsonStream::getObjectStringByName(const char* key, char* buffer, size_t leng
  * \return The number of characters written to the buffer is returned.
  */
 int JsonStream::getObjectStringByName_P(PGM_P key, char* buffer, size_t length) {
-    rewind();
-    if (!find_P(key))
+    uint16_t offset;
+    if (!seekValue(key, true, JSON_OBJECT, &offset))
         return -1;
-    if (!find(':'))
+    return getObjectString(offset, buffer, length);
+}
+//------------------------------------------------------------------------------
+/**
+ * Copy the string found at a given position.
+ *
+ * \param[in] offset The position of the opening quote.
+ * \param[out] buffer Target buffer to write the value.
+ * \param[in] length Maximum length to write to the buffer.
+ *
+ * \return The number of characters written to the buffer, -1 if the value is
+ * not a string.
+ */
+int JsonStream::getString(uint16_t offset, char* buffer, size_t length) const {
+    if (buffer_[offset] != '"')
         return -1;
-     if (!find('{'))
+    uint16_t end = skipValue(offset);
+    if (buffer_[end - 1] != '"' || end - offset < 2)
         return -1;
-    return readBytesUntil('}', buffer, length);
+    return decode(buffer_ + offset + 1, end - offset - 2, buffer, length);
 }
 //------------------------------------------------------------------------------
 /**
@@ -114,23 +564,16 @@ int JsonStream::getObjectStringByName_P(PGM_P key, char* buffer, size_t length)
  * \return The number of characters written to the buffer is returned.
  */
 int JsonStream::getStringByName(const char* key, char* buffer, size_t length) {
-    rewind();
-    uint8_t len = strlen(key);
-
-    char ch = '\0';
-    while (ch != '\"') {
-        if (find(key)) {
-            ch = buffer_[index_-len-1];
-        }
-        else {
+    if (tokens_ != NULL) {
+        int16_t value = findValue(key, false, JSON_STRING);
+        if (value < 0)
             return -1;
-        }
+        return copyString(tokens_[value], buffer, length);
     }
-    if (!find(':'))
+    uint16_t offset;
+    if (!seekValue(key, false, JSON_STRING, &offset))
         return -1;
-    if (!find('"'))
-        return -1;
-    return readBytesUntil('"', buffer, length);
+    return getString(offset, buffer, length);
 }
 //------------------------------------------------------------------------------
 /**
@@ -144,37 +587,762 @@ int JsonStream::getStringByName(const char* key, char* buffer, size_t length) {
  * \return The number of characters written to the buffer is returned.
  */
 int JsonStream::getStringByName_P(PGM_P key, char* buffer, size_t length) {
-    rewind();
-    if (!find_P(key))
+    if (tokens_ != NULL) {
+        int16_t value = findValue(key, true, JSON_STRING);
+        if (value < 0)
+            return -1;
+        return copyString(tokens_[value], buffer, length);
+    }
+    uint16_t offset;
+    if (!seekValue(key, true, JSON_STRING, &offset))
+        return -1;
+    return getString(offset, buffer, length);
+}
+//------------------------------------------------------------------------------
+/**
+ * Copy the string found at the end of a path, e.g. "data.sensors[2].name".
+ *
+ * \param[in] path Keys separated by dots, array indices between brackets.
+ * \param[out] buffer Target buffer to write the value.
+ * \param[in] length Maximum length to write to the buffer.
+ *
+ * \return The number of characters written to the buffer, -1 if the path does
+ * not lead to a string.
+ */
+int JsonStream::getStringByPath(const char* path, char* buffer, size_t length) {
+    uint16_t offset;
+    if (!seekPath(path, false, &offset))
         return -1;
-    if (!find(':'))
+    return getString(offset, buffer, length);
+}
+//------------------------------------------------------------------------------
+/**
+ * Like getStringByPath() but with a path located in the program memory.
+ *
+ * \param[in] path Keys separated by dots, array indices between brackets.
+ * \param[out] buffer Target buffer to write the value.
+ * \param[in] length Maximum length to write to the buffer.
+ *
+ * \return The number of characters written to the buffer, -1 if the path does
+ * not lead to a string.
+ */
+int JsonStream::getStringByPath_P(PGM_P path, char* buffer, size_t length) {
+    uint16_t offset;
+    if (!seekPath(path, true, &offset))
         return -1;
-    if (!find('"'))
+    return getString(offset, buffer, length);
+}
+//------------------------------------------------------------------------------
+/**
+ * Parse the unsigned integer corresponding to the key string provided.
+ *
+ * \param[in] key Key string to find.
+ * \param[out] value The location to store the value, left untouched unless
+ * JSON_OK is returned.
+ *
+ * \return JSON_OK, JSON_NOT_FOUND, JSON_TYPE_MISMATCH if the value is not an
+ * integer or JSON_OVERFLOW, which includes negative values.
+ */
+uint8_t JsonStream::getUint32ByName(const char* key, uint32_t* value) {
+    return parseUint32(key, false, value);
+}
+//------------------------------------------------------------------------------
+/**
+ * Like getUint32ByName() but with a key located in the program memory.
+ *
+ * \param[in] key Key string to find.
+ * \param[out] value The location to store the value.
+ *
+ * \return JSON_OK, JSON_NOT_FOUND, JSON_TYPE_MISMATCH or JSON_OVERFLOW.
+ */
+uint8_t JsonStream::getUint32ByName_P(PGM_P key, uint32_t* value) {
+    return parseUint32(key, true, value);
+}
+//------------------------------------------------------------------------------
+/**
+ * Get the value of a key without copying it.
+ *
+ * \param[in] key The key to look for.
+ * \param[in] progmem Whether the key resides in program memory.
+ * \param[out] view The location of the value in the buffer.
+ *
+ * \return true is returned if the key is found.
+ */
+bool JsonStream::getView(const char* key, bool progmem, JsonView* view) {
+    if (tokens_ != NULL) {
+        int16_t value = findValue(key, progmem, 0);
+        if (value < 0)
+            return false;
+        JsonToken &token = tokens_[value];
+        if (token.type == JSON_STRING) {
+            // the index does not need the raw text anymore
+            token.end = token.start + decode(buffer_ + token.start,
+                token.end - token.start, buffer_ + token.start,
+                token.end - token.start + 1);
+            token.type |= JSON_DECODED;
+        }
+        view->ptr = buffer_ + token.start;
+        view->len = token.end - token.start;
+        return true;
+    }
+    uint16_t start;
+    if (!seekValue(key, progmem, 0, &start))
+        return false;
+    uint16_t end = skipValue(start);
+    if (start < end && buffer_[start] == '"') {
+        start++;
+        if (end > start && buffer_[end - 1] == '"')
+            end--;
+    }
+    view->ptr = buffer_ + start;
+    view->len = end - start;
+    return true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Get the value of a key without copying it.
+ *
+ * \param[in] key Key string to find.
+ * \param[out] view The location of the value in the buffer. Strings are given
+ * without their quotes, other values as they appear in the document.
+ *
+ * \return true is returned if the key is found.
+ *
+ * \note Once the document is indexed, strings are unescaped and
+ * null-terminated in place, which alters the buffer: it must not be scanned
+ * again (by extract_P(), path lookups or lookups without an index) afterwards,
+ * and index() refuses to rebuild the index until it has been dropped. Without
+ * an index the buffer is left untouched, so the view may contain escape
+ * sequences and is not null-terminated.
+ */
+bool JsonStream::getViewByName(const char* key, JsonView* view) {
+    return getView(key, false, view);
+}
+//------------------------------------------------------------------------------
+/**
+ * Like getViewByName() but with a key located in the program memory.
+ *
+ * \param[in] key Key string to find.
+ * \param[out] view The location of the value in the buffer.
+ *
+ * \return true is returned if the key is found.
+ */
+bool JsonStream::getViewByName_P(PGM_P key, JsonView* view) {
+    return getView(key, true, view);
+}
+//------------------------------------------------------------------------------
+/**
+ * Get the value found at the end of a path without copying it.
+ *
+ * \param[in] path Keys separated by dots, array indices between brackets.
+ * \param[out] view The location of the value in the buffer. Strings are given
+ * without their quotes and escape sequences are left as is, other values as
+ * they appear in the document.
+ *
+ * \return true is returned if the path leads to a value.
+ */
+bool JsonStream::getViewByPath(const char* path, JsonView* view) {
+    uint16_t start;
+    if (!seekPath(path, false, &start))
+        return false;
+    uint16_t end = skipValue(start);
+    if (buffer_[start] == '"' && end - start >= 2) {
+        start++;
+        end--;
+    }
+    view->ptr = buffer_ + start;
+    view->len = end - start;
+    return true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Like getViewByPath() but with a path located in the program memory.
+ *
+ * \param[in] path Keys separated by dots, array indices between brackets.
+ * \param[out] view The location of the value in the buffer.
+ *
+ * \return true is returned if the path leads to a value.
+ */
+bool JsonStream::getViewByPath_P(PGM_P path, JsonView* view) {
+    uint16_t start;
+    if (!seekPath(path, true, &start))
+        return false;
+    uint16_t end = skipValue(start);
+    if (buffer_[start] == '"' && end - start >= 2) {
+        start++;
+        end--;
+    }
+    view->ptr = buffer_ + start;
+    view->len = end - start;
+    return true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Tokenize the whole document in a single pass so that subsequent lookups do
+ * not have to scan the buffer again.
+ *
+ * \param[out] tokens Array where the tokens are stored, which must remain
+ * valid for as long as the stream is used. NULL to drop the current index.
+ * \param[in] maxTokens Number of tokens the array can hold.
+ *
+ * \return The number of tokens found, -1 if the array is too small or the
+ * document is malformed, in which case lookups keep scanning the buffer.
+ * -1 is also returned if strings of the current index have been decoded in
+ * place, in which case the current index is kept.
+ *
+ * \note index() must be called again if the contents of the buffer change.
+ * Api drops the index before each call, since the response overwrites the
+ * buffer. Once getViewByName() has decoded strings in place, the buffer can
+ * only be indexed again after the index has been dropped and new contents
+ * have been written.
+ */
+int JsonStream::index(JsonToken* tokens, uint8_t maxTokens) {
+    // the raw text of decoded strings is gone, keep the index matching it
+    if (tokens != NULL && decoded())
         return -1;
-    return readBytesUntil('"', buffer, length);
+    tokens_ = NULL;
+    tokenCount_ = 0;
+    if (tokens == NULL)
+        return 0;
+    uint8_t count = 0;
+    uint8_t depth = 0;
+    // innermost container which is still open
+    int16_t parent = -1;
+    bool expectKey = false;
+    for (uint16_t i = 0; i < bufferSize_ && buffer_[i] != 0x00; i++) {
+        char c = buffer_[i];
+        switch (c) {
+            case '{' :
+            case '[' :
+                if (count == maxTokens)
+                    return -1;
+                tokens[count].start = i;
+                tokens[count].end = 0;
+                tokens[count].type = (c == '{') ? JSON_OBJECT : JSON_ARRAY;
+                tokens[count].depth = depth++;
+                parent = count++;
+                expectKey = (c == '{');
+                break;
+            case '}' :
+            case ']' :
+                if (parent < 0 || tokens[parent].type
+                    != ((c == '}') ? JSON_OBJECT : JSON_ARRAY))
+                    return -1;
+                tokens[parent].end = i + 1;
+                depth--;
+                // go back to the enclosing container
+                while (--parent >= 0) {
+                    if (tokens[parent].end == 0
+                        && (tokens[parent].type == JSON_OBJECT
+                        || tokens[parent].type == JSON_ARRAY))
+                        break;
+                }
+                expectKey = false;
+                break;
+            case '"' : {
+                if (count == maxTokens)
+                    return -1;
+                uint16_t start = i + 1;
+                // skip the string, including escaped quotes
+                for (i++; i < bufferSize_ && buffer_[i] != '"'; i++) {
+                    if (buffer_[i] == 0x00)
+                        return -1;
+                    else if (buffer_[i] == '\\')
+                        i++;
+                }
+                if (i >= bufferSize_)
+                    return -1;
+                tokens[count].start = start;
+                tokens[count].end = i;
+                tokens[count].type = expectKey ? JSON_KEY : JSON_STRING;
+                tokens[count].depth = depth;
+                count++;
+                expectKey = false;
+                break;
+            }
+            case ',' :
+                expectKey = (parent >= 0 && tokens[parent].type == JSON_OBJECT);
+                break;
+            case ':' :
+            case ' ' :
+            case '\t' :
+            case '\r' :
+            case '\n' :
+                break;
+            default : {
+                if (count == maxTokens)
+                    return -1;
+                tokens[count].start = i;
+                // a primitive ends with a delimiter
+                i = skipValue(i);
+                tokens[count].end = i--;
+                tokens[count].type = JSON_PRIMITIVE;
+                tokens[count].depth = depth;
+                count++;
+                expectKey = false;
+                break;
+            }
+        }
+    }
+    if (parent >= 0)
+        return -1;
+    tokens_ = tokens;
+    tokenCount_ = count;
+    return count;
+}
+//------------------------------------------------------------------------------
+/**
+ * Compare a part of the buffer with a string.
+ *
+ * \param[in] start The offset of the first character to compare.
+ * \param[in] length The number of characters to compare.
+ * \param[in] key The string to compare the characters with.
+ * \param[in] progmem Whether the string resides in program memory.
+ *
+ * \return true is returned if the characters and the string are identical.
+ */
+bool JsonStream::keyEquals(uint16_t start, uint16_t length, const char* key,
+    bool progmem) const {
+    if (progmem)
+        return (strlen_P(key) == length
+            && strncmp_P(buffer_ + start, key, length) == 0);
+    else
+        return (strlen(key) == length
+            && strncmp(buffer_ + start, key, length) == 0);
 }
 //------------------------------------------------------------------------------
 /**
- * Read one byte from the buffer, unescape characters which are escaped.
+ * Parse a boolean member of the root object.
+ *
+ * \param[in] key The key to look for.
+ * \param[in] progmem Whether the key resides in program memory.
+ * \param[out] value The location to store the value.
+ *
+ * \return JSON_OK, JSON_NOT_FOUND or JSON_TYPE_MISMATCH.
+ */
+uint8_t JsonStream::parseBool(const char* key, bool progmem, bool* value)
+    const {
+    uint16_t offset;
+    uint8_t status = seekPrimitive(key, progmem, &offset);
+    if (status != JSON_OK)
+        return status;
+    uint16_t length = skipValue(offset) - offset;
+    if (keyEquals(offset, length, JSON_TRUE, true))
+        *value = true;
+    else if (keyEquals(offset, length, JSON_FALSE, true))
+        *value = false;
+    else
+        return JSON_TYPE_MISMATCH;
+    return JSON_OK;
+}
+//------------------------------------------------------------------------------
+/**
+ * Parse a numeric member of the root object into a signed integer.
+ *
+ * \param[in] key The key to look for.
+ * \param[in] progmem Whether the key resides in program memory.
+ * \param[in] decimals The number of digits to keep after the decimal point.
+ * \param[in] integer Whether a fraction or an exponent is a type mismatch.
+ * \param[out] value The location to store the value.
+ *
+ * \return JSON_OK, JSON_NOT_FOUND, JSON_TYPE_MISMATCH or JSON_OVERFLOW.
+ */
+uint8_t JsonStream::parseInt32(const char* key, bool progmem, uint8_t decimals,
+    bool integer, int32_t* value) const {
+    uint16_t offset;
+    uint8_t status = seekPrimitive(key, progmem, &offset);
+    if (status != JSON_OK)
+        return status;
+    return parseInt32(offset, decimals, integer, value);
+}
+//------------------------------------------------------------------------------
+/**
+ * Parse the number found at a given position into a signed integer.
+ *
+ * \param[in] offset The position of the first character of the number.
+ * \param[in] decimals The number of digits to keep after the decimal point.
+ * \param[in] integer Whether a fraction or an exponent is a type mismatch.
+ * \param[out] value The location to store the value.
+ *
+ * \return JSON_OK, JSON_TYPE_MISMATCH or JSON_OVERFLOW.
+ */
+uint8_t JsonStream::parseInt32(uint16_t offset, uint8_t decimals,
+    bool integer, int32_t* value) const {
+    uint32_t magnitude;
+    bool negative;
+    uint8_t status = parseNumber(offset, decimals, integer, &magnitude,
+        &negative);
+    if (status != JSON_OK)
+        return status;
+    if (magnitude > (negative ? 0x80000000UL : 0x7FFFFFFFUL))
+        return JSON_OVERFLOW;
+    *value = negative ? (int32_t)(0 - magnitude) : (int32_t)magnitude;
+    return JSON_OK;
+}
+//------------------------------------------------------------------------------
+/**
+ * Check whether a member of the root object is null.
+ *
+ * \param[in] key The key to look for.
+ * \param[in] progmem Whether the key resides in program memory.
+ *
+ * \return JSON_OK if the value is null, JSON_NOT_FOUND or JSON_TYPE_MISMATCH
+ * otherwise.
+ */
+uint8_t JsonStream::parseNull(const char* key, bool progmem) const {
+    uint16_t offset;
+    uint8_t status = seekPrimitive(key, progmem, &offset);
+    if (status != JSON_OK)
+        return status;
+    if (!keyEquals(offset, skipValue(offset) - offset, JSON_NULL, true))
+        return JSON_TYPE_MISMATCH;
+    return JSON_OK;
+}
+//------------------------------------------------------------------------------
+/**
+ * Parse the digits of a number directly from the buffer.
+ *
+ * \param[in] offset The position of the first character of the number.
+ * \param[in] decimals The number of digits to keep after the decimal point,
+ * missing ones count as zeros and further ones are truncated.
+ * \param[in] integer Whether a fraction is a type mismatch rather than being
+ * scaled.
+ * \param[out] magnitude The absolute value, multiplied by 10^decimals.
+ * \param[out] negative Whether the number has a minus sign.
+ *
+ * \return JSON_OK, JSON_TYPE_MISMATCH if the value is not a number or has an
+ * exponent, JSON_OVERFLOW if the magnitude exceeds 32 bits.
+ */
+uint8_t JsonStream::parseNumber(uint16_t offset, uint8_t decimals,
+    bool integer, uint32_t* magnitude, bool* negative) const {
+    *negative = (buffer_[offset] == '-');
+    if (*negative)
+        offset++;
+    if (atEnd(offset) || buffer_[offset] < '0' || buffer_[offset] > '9')
+        return JSON_TYPE_MISMATCH;
+    uint32_t value = 0;
+    bool overflow = false;
+    bool point = false;
+    uint8_t places = 0;
+    for (; !atEnd(offset); offset++) {
+        char c = buffer_[offset];
+        if (c == '.' && !point && !integer) {
+            point = true;
+            continue;
+        }
+        if (c < '0' || c > '9')
+            break;
+        if (point) {
+            if (places == decimals)
+                continue;
+            places++;
+        }
+        uint8_t digit = c - '0';
+        if (value > (0xFFFFFFFFUL - digit) / 10)
+            overflow = true;
+        else
+            value = 10 * value + digit;
+    }
+    // exponents and misplaced characters
+    if (!atEnd(offset) && strchr_P(JSON_DELIMITERS, buffer_[offset]) == NULL)
+        return JSON_TYPE_MISMATCH;
+    for (; places < decimals; places++) {
+        if (value > 0xFFFFFFFFUL / 10)
+            overflow = true;
+        else
+            value *= 10;
+    }
+    if (overflow)
+        return JSON_OVERFLOW;
+    *magnitude = value;
+    return JSON_OK;
+}
+//------------------------------------------------------------------------------
+/**
+ * Parse a numeric member of the root object into an unsigned integer.
+ *
+ * \param[in] key The key to look for.
+ * \param[in] progmem Whether the key resides in program memory.
+ * \param[out] value The location to store the value.
+ *
+ * \return JSON_OK, JSON_NOT_FOUND, JSON_TYPE_MISMATCH or JSON_OVERFLOW.
+ */
+uint8_t JsonStream::parseUint32(const char* key, bool progmem,
+    uint32_t* value) const {
+    uint16_t offset;
+    uint8_t status = seekPrimitive(key, progmem, &offset);
+    if (status != JSON_OK)
+        return status;
+    uint32_t magnitude;
+    bool negative;
+    status = parseNumber(offset, 0, true, &magnitude, &negative);
+    if (status != JSON_OK)
+        return status;
+    if (negative && magnitude != 0)
+        return JSON_OVERFLOW;
+    *value = magnitude;
+    return JSON_OK;
+}
+//------------------------------------------------------------------------------
+/**
+ * Read one byte from the buffer, decoding the escape sequences into UTF-8.
  *
  * \return The received byte or -1 if a timeout occurs.
  */
 int JsonStream::read() {
-    int c = BufferedStream::read();
-    if (c == '\\') {
-        c = BufferedStream::read();
-        switch (c) {
-            case 'b' :
-                return '\b';
-            case 'f' :
-                return '\f';
-            case 'n' :
-                return '\n';
-            case 'r' :
-                return '\r';
-            case 't' :
-                return '\t';
+    while (pendingIndex_ == pendingLength_) {
+        int c = BufferedStream::read();
+        pendingIndex_ = 0;
+        if (c < 0) {
+            pendingLength_ = decoder_.finish(pending_);
+            if (pendingLength_ == 0)
+                return -1;
+        }
+        else
+            pendingLength_ = decoder_.feed(c, pending_);
+    }
+    return (uint8_t)pending_[pendingIndex_++];
+}
+//------------------------------------------------------------------------------
+/** Go back to the beginning of the document. */
+void JsonStream::rewind() {
+    BufferedStream::rewind();
+    decoder_.reset();
+    pendingLength_ = 0;
+    pendingIndex_ = 0;
+}
+//------------------------------------------------------------------------------
+/**
+ * Find a member of an object, skipping the other members without looking
+ * into their strings or nested values.
+ *
+ * \param[in,out] offset The position of the opening brace of the object,
+ * replaced with the position of the value of the member if it is found.
+ * \param[in] key The key to look for, which needs not be null-terminated.
+ * \param[in] length The number of characters of the key.
+ * \param[in] progmem Whether the key resides in program memory.
+ *
+ * \return true is returned if the object has a member with this exact key.
+ */
+bool JsonStream::seekMember(uint16_t* offset, const char* key, uint8_t length,
+    bool progmem) const {
+    uint16_t i = *offset;
+    if (atEnd(i) || buffer_[i] != '{')
+        return false;
+    i = skipSpace(i + 1);
+    do {
+        if (atEnd(i) || buffer_[i] != '"')
+            return false;
+        uint16_t start = i + 1;
+        i = skipValue(i);
+        uint16_t keyLength = i - 1 - start;
+        i = skipSpace(i);
+        if (atEnd(i) || buffer_[i] != ':')
+            return false;
+        i = skipSpace(i + 1);
+        if (keyLength == length && (progmem
+            ? strncmp_P(buffer_ + start, key, length)
+            : strncmp(buffer_ + start, key, length)) == 0) {
+            *offset = i;
+            return !atEnd(i);
+        }
+        i = skipSpace(skipValue(i));
+        if (atEnd(i) || buffer_[i] != ',')
+            return false;
+        i = skipSpace(i + 1);
+    } while (1);
+}
+//------------------------------------------------------------------------------
+/**
+ * Walk down a path in a single pass, skipping the members and the elements
+ * which are not on the path without copying them.
+ *
+ * \param[in] path Keys separated by dots, array indices between brackets.
+ * \param[in] progmem Whether the path resides in program memory.
+ * \param[out] offset The position of the first character of the value.
+ *
+ * \return true is returned if the path leads to a value.
+ *
+ * \note The raw text is walked, so strings must not have been decoded in
+ * place by getViewByName() beforehand.
+ */
+bool JsonStream::seekPath(const char* path, bool progmem, uint16_t* offset)
+    const {
+    uint16_t i = skipSpace(0);
+    do {
+        char c = progmem ? pgm_read_byte(path) : *path;
+        if (c == 0x00)
+            break;
+        else if (c == '.')
+            path++;
+        else if (c == '[') {
+            // skip the elements preceding the index
+            uint16_t n = 0;
+            for (path++; ; path++) {
+                c = progmem ? pgm_read_byte(path) : *path;
+                if (c < '0' || c > '9')
+                    break;
+                n = 10 * n + (c - '0');
+            }
+            if (c != ']' || atEnd(i) || buffer_[i] != '[')
+                return false;
+            path++;
+            i = skipSpace(i + 1);
+            while (n-- > 0) {
+                i = skipSpace(skipValue(i));
+                if (atEnd(i) || buffer_[i] != ',')
+                    return false;
+                i = skipSpace(i + 1);
+            }
+            if (atEnd(i) || buffer_[i] == ']')
+                return false;
+        }
+        else {
+            // measure the key
+            uint8_t length = 0;
+            do {
+                c = progmem ? pgm_read_byte(path + length) : path[length];
+                if (c == 0x00 || c == '.' || c == '[')
+                    break;
+                length++;
+            } while (1);
+            if (!seekMember(&i, path, length, progmem))
+                return false;
+            path += length;
         }
+    } while (1);
+    if (atEnd(i))
+        return false;
+    *offset = i;
+    return true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Locate a number or a literal member of the root object.
+ *
+ * \param[in] key The key to look for.
+ * \param[in] progmem Whether the key resides in program memory.
+ * \param[out] offset The position of the first character of the value.
+ *
+ * \return JSON_OK, JSON_NOT_FOUND or JSON_TYPE_MISMATCH if the value is a
+ * string, an object or an array.
+ */
+uint8_t JsonStream::seekPrimitive(const char* key, bool progmem,
+    uint16_t* offset) const {
+    if (!seekValue(key, progmem, 0, offset))
+        return JSON_NOT_FOUND;
+    char c = buffer_[*offset];
+    if (c == '"' || c == '{' || c == '[')
+        return JSON_TYPE_MISMATCH;
+    return JSON_OK;
+}
+//------------------------------------------------------------------------------
+/**
+ * Locate the value of a member of the root object.
+ *
+ * \param[in] key The key to look for.
+ * \param[in] progmem Whether the key resides in program memory.
+ * \param[in] type The expected type of the value, 0 for any type.
+ * \param[out] offset The position of the first character of the value, the
+ * opening quote for strings.
+ *
+ * \return true is returned if the key is found with a value of the expected
+ * type.
+ *
+ * \note Only the keys of the root object are compared, so a string value or
+ * a nested member spelled like the key is never mistaken for it.
+ */
+bool JsonStream::seekValue(const char* key, bool progmem, uint8_t type,
+    uint16_t* offset) const {
+    if (tokens_ != NULL) {
+        int16_t value = findValue(key, progmem, type);
+        if (value < 0)
+            return false;
+        *offset = tokens_[value].start;
+        if ((tokens_[value].type & ~JSON_DECODED) == JSON_STRING)
+            (*offset)--;
+        return true;
     }
-    return c;
+    uint16_t i = skipSpace(0);
+    uint8_t length = progmem ? strlen_P(key) : strlen(key);
+    if (!seekMember(&i, key, length, progmem))
+        return false;
+    if (type != 0 && typeOf(buffer_[i]) != type)
+        return false;
+    *offset = i;
+    return true;
 }
+//------------------------------------------------------------------------------
+/**
+ * Skip white space.
+ *
+ * \param[in] offset The position to start from.
+ *
+ * \return The position of the next significant character.
+ */
+uint16_t JsonStream::skipSpace(uint16_t offset) const {
+    while (!atEnd(offset) && (buffer_[offset] == ' '
+        || buffer_[offset] == '\t' || buffer_[offset] == '\r'
+        || buffer_[offset] == '\n'))
+        offset++;
+    return offset;
+}
+//------------------------------------------------------------------------------
+/**
+ * Skip a value, including everything nested in it.
+ *
+ * \param[in] offset The position of the first character of the value.
+ *
+ * \return The position following the value.
+ */
+uint16_t JsonStream::skipValue(uint16_t offset) const {
+    if (atEnd(offset))
+        return offset;
+    char c = buffer_[offset];
+    if (c == '"') {
+        for (offset++; !atEnd(offset) && buffer_[offset] != '"'; offset++) {
+            if (buffer_[offset] == '\\')
+                offset++;
+        }
+        return atEnd(offset) ? offset : offset + 1;
+    }
+    else if (c == '{' || c == '[') {
+        uint8_t depth = 0;
+        while (!atEnd(offset)) {
+            c = buffer_[offset];
+            if (c == '"') {
+                offset = skipValue(offset);
+                continue;
+            }
+            else if (c == '{' || c == '[')
+                depth++;
+            else if ((c == '}' || c == ']') && --depth == 0)
+                return offset + 1;
+            offset++;
+        }
+        return offset;
+    }
+    // numbers and literals end with a delimiter
+    while (!atEnd(offset) && strchr_P(JSON_DELIMITERS, buffer_[offset]) == NULL)
+        offset++;
+    return offset;
+}
+//------------------------------------------------------------------------------
+/**
+ * Tell the type of a value from its first character.
+ *
+ * \param[in] c The first character of the value.
+ *
+ * \return JSON_STRING, JSON_OBJECT, JSON_ARRAY or JSON_PRIMITIVE.
+ */
+uint8_t JsonStream::typeOf(char c) {
+    if (c == '"')
+        return JSON_STRING;
+    else if (c == '{')
+        return JSON_OBJECT;
+    else if (c == '[')
+        return JSON_ARRAY;
+    else
+        return JSON_PRIMITIVE;
+}
+
@@ -24,10 +24,105 @@
  * \brief JsonStream class.
  */
 #include <BufferedStream.h>
+#include <JsonDecoder.h>
+class JsonCursor;
+//------------------------------------------------------------------------------
+// JSON token types
+/** Object, delimited by braces */
+uint8_t const JSON_OBJECT = 1;
+/** Array, delimited by brackets */
+uint8_t const JSON_ARRAY = 2;
+/** String used as the key of an object member */
+uint8_t const JSON_KEY = 3;
+/** String value */
+uint8_t const JSON_STRING = 4;
+/** Number, true, false or null */
+uint8_t const JSON_PRIMITIVE = 5;
+/** Flag set on the type of the strings which have been decoded in place */
+uint8_t const JSON_DECODED = 0x80;
+//------------------------------------------------------------------------------
+// Types of the fields filled by extract_P()
+/** Null-terminated string, unescaped and truncated to the capacity */
+uint8_t const JSON_FIELD_STRING = 0;
+/** int32_t */
+uint8_t const JSON_FIELD_INT32 = 1;
+/** bool */
+uint8_t const JSON_FIELD_BOOL = 2;
+/** Null-terminated JSON text of an object, braces included */
+uint8_t const JSON_FIELD_OBJECT = 3;
+//------------------------------------------------------------------------------
+// Status of the typed getters
+/** The value has been stored */
+uint8_t const JSON_OK = 0;
+/** The key is missing */
+uint8_t const JSON_NOT_FOUND = 1;
+/** The value does not have the requested type */
+uint8_t const JSON_TYPE_MISMATCH = 2;
+/** The value does not fit in the requested type */
+uint8_t const JSON_OVERFLOW = 3;
+//------------------------------------------------------------------------------
+/**
+ * \struct JsonToken
+ * \brief Location of a JSON element in the buffer of a JsonStream.
+ */
+struct JsonToken {
+    /** Offset of the first character, after the quote for strings */
+    uint16_t start;
+    /** Offset following the last character, the closing quote for strings */
+    uint16_t end;
+    /** Type of element */
+    uint8_t type;
+    /** Nesting level, 0 for the root element */
+    uint8_t depth;
+};
+//------------------------------------------------------------------------------
+/**
+ * \struct JsonView
+ * \brief Value of a JSON member, read directly from the buffer of a
+ * JsonStream.
+ */
+struct JsonView {
+    /** First character of the value, after the quote for strings */
+    const char* ptr;
+    /** Number of characters */
+    uint16_t len;
+};
+//------------------------------------------------------------------------------
+/**
+ * \struct JsonField
+ * \brief Member of a JSON object to store in a field of a structure.
+ *
+ * Tables of fields are meant to reside in program memory, see JSON_FIELD().
+ */
+struct JsonField {
+    /** Key of the member in program memory */
+    PGM_P key;
+    /** Type of the field */
+    uint8_t type;
+    /** Offset of the field in the target structure */
+    uint16_t offset;
+    /** Size of the field */
+    uint16_t capacity;
+};
+/**
+ * Describe a field of a structure for extract_P().
+ *
+ * \param[in] key The key of the member in program memory.
+ * \param[in] type The type of the field.
+ * \param[in] target The type of the structure.
+ * \param[in] member The name of the field in the structure.
+ */
+#define JSON_FIELD(key, type, target, member) \
+    {key, type, offsetof(target, member), sizeof(((target*)0)->member)}
 //------------------------------------------------------------------------------
 /**
  * \class JsonStream
  * \brief JSON parsing helper class.
+ *
+ * By default every lookup walks the members of the root object from the
+ * beginning, skipping their values. Calling index() once tokenizes the whole
+ * document into a caller-supplied array, after which lookups only go through
+ * the keys.
  */
 class JsonStream : public BufferedStream {
 public:
@@ -38,14 +133,103 @@ public:
      * \param[in] bufferSize Size of the buffer;
      */
     JsonStream(char* buffer, size_t bufferSize = 0) :
-        BufferedStream(buffer, bufferSize) {}
+        BufferedStream(buffer, bufferSize), tokens_(NULL), tokenCount_(0),
+        pendingLength_(0), pendingIndex_(0) {}
+    /**
+     * Construct an instance of JsonStream over a value of another document,
+     * e.g. an element returned by JsonCursor, without copying it.
+     *
+     * \param[in] view The value to parse.
+     */
+    JsonStream(const JsonView &view) :
+        BufferedStream((char*)view.ptr, view.len), tokens_(NULL),
+        tokenCount_(0), pendingLength_(0), pendingIndex_(0) {}
+    uint8_t extract_P(const JsonField* fields, uint8_t count, void* target);
     virtual int read();
+    /** Unescaped bytes have to go through read() one at a time */
+    virtual int readBlock(char* buffer, size_t length) {
+        return ExtendedStream::readBlock(buffer, length);
+    }
+    virtual void rewind();
+    bool getArrayByName(const char* key, JsonCursor* cursor);
+    bool getArrayByName_P(PGM_P key, JsonCursor* cursor);
+    bool getArrayByPath(const char* path, JsonCursor* cursor);
+    bool getArrayByPath_P(PGM_P path, JsonCursor* cursor);
+    uint8_t getBoolByName(const char* key, bool* value);
+    uint8_t getBoolByName_P(PGM_P key, bool* value);
+    uint8_t getDecimalByName(const char* key, uint8_t decimals, int32_t* value);
+    uint8_t getDecimalByName_P(PGM_P key, uint8_t decimals, int32_t* value);
+    uint8_t getInt32ByName(const char* key, int32_t* value);
+    uint8_t getInt32ByName_P(PGM_P key, int32_t* value);
     int getIntegerByName(const char* key);
     int getIntegerByName_P(PGM_P key);
+    int getIntegerByPath(const char* path);
+    int getIntegerByPath_P(PGM_P path);
+    uint8_t getNullByName(const char* key);
+    uint8_t getNullByName_P(PGM_P key);
     int getObjectStringByName(const char* key, char* buffer, size_t length);
     int getObjectStringByName_P(PGM_P key, char* buffer, size_t length);
     int getStringByName(const char* key, char* buffer, size_t length);
     int getStringByName_P(PGM_P key, char* buffer, size_t length);
+    int getStringByPath(const char* path, char* buffer, size_t length);
+    int getStringByPath_P(PGM_P path, char* buffer, size_t length);
+    uint8_t getUint32ByName(const char* key, uint32_t* value);
+    uint8_t getUint32ByName_P(PGM_P key, uint32_t* value);
+    bool getViewByName(const char* key, JsonView* view);
+    bool getViewByName_P(PGM_P key, JsonView* view);
+    bool getViewByPath(const char* path, JsonView* view);
+    bool getViewByPath_P(PGM_P path, JsonView* view);
+    int index(JsonToken* tokens, uint8_t maxTokens);
+//------------------------------------------------------------------------------
+private:
+    friend class JsonCursor;
+    /** \return true if the offset is past the end of the document. */
+    bool atEnd(uint16_t offset) const {
+        return (offset >= bufferSize_ || buffer_[offset] == 0x00);
+    }
+    int copyString(const JsonToken &token, char* buffer, size_t length) const;
+    static uint16_t decode(const char* source, uint16_t length,
+        char* destination, uint16_t capacity);
+    bool decoded() const;
+    bool extractField(const JsonField &field, uint16_t offset, uint8_t* target);
+    int16_t findValue(const char* key, bool progmem, uint8_t type) const;
+    int getInteger(uint16_t offset) const;
+    int getObjectString(uint16_t offset, char* buffer, size_t length) const;
+    int getString(uint16_t offset, char* buffer, size_t length) const;
+    bool getView(const char* key, bool progmem, JsonView* view);
+    bool keyEquals(uint16_t start, uint16_t length, const char* key,
+        bool progmem) const;
+    uint8_t parseBool(const char* key, bool progmem, bool* value) const;
+    uint8_t parseInt32(const char* key, bool progmem, uint8_t decimals,
+        bool integer, int32_t* value) const;
+    uint8_t parseInt32(uint16_t offset, uint8_t decimals, bool integer,
+        int32_t* value) const;
+    uint8_t parseNull(const char* key, bool progmem) const;
+    uint8_t parseNumber(uint16_t offset, uint8_t decimals, bool integer,
+        uint32_t* magnitude, bool* negative) const;
+    uint8_t parseUint32(const char* key, bool progmem, uint32_t* value) const;
+    bool seekMember(uint16_t* offset, const char* key, uint8_t length,
+        bool progmem) const;
+    bool seekPath(const char* path, bool progmem, uint16_t* offset) const;
+    uint8_t seekPrimitive(const char* key, bool progmem, uint16_t* offset)
+        const;
+    bool seekValue(const char* key, bool progmem, uint8_t type,
+        uint16_t* offset) const;
+    uint16_t skipSpace(uint16_t offset) const;
+    uint16_t skipValue(uint16_t offset) const;
+    static uint8_t typeOf(char c);
+    /** Tokens of the document, NULL if it has not been indexed */
+    JsonToken* tokens_;
+    /** Number of tokens of the document */
+    uint8_t tokenCount_;
+    /** Decoder of the escape sequences met by read() */
+    JsonDecoder decoder_;
+    /** Decoded bytes not returned by read() yet */
+    char pending_[JSON_DECODED_SIZE];
+    /** Number of decoded bytes */
+    uint8_t pendingLength_;
+    /** Number of decoded bytes already returned */
+    uint8_t pendingIndex_;
 };
 
 #endif // JSON_STREAM_H
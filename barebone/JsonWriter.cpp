@@ -0,0 +1,302 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <JsonWriter.h>
+//------------------------------------------------------------------------------
+/** Literal true */
+const char PROGMEM JSON_WRITER_TRUE[] = "true";
+/** Literal false */
+const char PROGMEM JSON_WRITER_FALSE[] = "false";
+/** Literal null */
+const char PROGMEM JSON_WRITER_NULL[] = "null";
+/** Hexadecimal digits of the \u escape sequences */
+const char PROGMEM JSON_WRITER_HEX[] = "0123456789abcdef";
+//------------------------------------------------------------------------------
+/** Construct an instance of JsonWriter which only measures the text. */
+JsonWriter::JsonWriter() :
+    out_(NULL),
+    buffer_(NULL),
+    size_(0),
+    length_(0),
+    comma_(false)
+{
+}
+//------------------------------------------------------------------------------
+/**
+ * Construct an instance of JsonWriter which prints the text.
+ *
+ * \param[in] out The Print the text is sent to.
+ */
+JsonWriter::JsonWriter(Print& out) :
+    out_(&out),
+    buffer_(NULL),
+    size_(0),
+    length_(0),
+    comma_(false)
+{
+}
+//------------------------------------------------------------------------------
+/**
+ * Construct an instance of JsonWriter which writes the text to a buffer.
+ *
+ * \param[out] buffer The buffer where the null-terminated text is written.
+ * \param[in] bufferSize The size of the buffer, the text being truncated if
+ * needed.
+ */
+JsonWriter::JsonWriter(char* buffer, size_t bufferSize) :
+    out_(NULL),
+    buffer_(buffer),
+    size_(bufferSize),
+    length_(0),
+    comma_(false)
+{
+    if (size_ > 0)
+        buffer_[0] = 0x00;
+}
+//------------------------------------------------------------------------------
+/** Open an array, as a value or as an element. */
+void JsonWriter::beginArray() {
+    separate();
+    put('[');
+    comma_ = false;
+}
+//------------------------------------------------------------------------------
+/** Open an object, as a value or as an element. */
+void JsonWriter::beginObject() {
+    separate();
+    put('{');
+    comma_ = false;
+}
+//------------------------------------------------------------------------------
+/**
+ * Write a boolean value.
+ *
+ * \param[in] value The value to write.
+ */
+void JsonWriter::boolean(bool value) {
+    separate();
+    PGM_P literal = value ? JSON_WRITER_TRUE : JSON_WRITER_FALSE;
+    for (char c; (c = pgm_read_byte(literal)) != 0x00; literal++)
+        put(c);
+    comma_ = true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Write a fixed-point decimal number, e.g. 2150 with 2 decimals is written as
+ * 21.50.
+ *
+ * \param[in] value The value multiplied by 10^decimals.
+ * \param[in] decimals The number of digits after the decimal point.
+ */
+void JsonWriter::decimal(int32_t value, uint8_t decimals) {
+    separate();
+    uint32_t magnitude = value;
+    if (value < 0) {
+        put('-');
+        magnitude = 0 - magnitude;
+    }
+    // at most 10 digits and the decimal point
+    char digits[12];
+    uint8_t n = 0;
+    do {
+        digits[n++] = '0' + magnitude % 10;
+        magnitude /= 10;
+        if (n == decimals)
+            digits[n++] = '.';
+    } while ((magnitude > 0 || (decimals > 0 && n <= decimals + 1))
+        && n < sizeof(digits));
+    while (n > 0)
+        put(digits[--n]);
+    comma_ = true;
+}
+//------------------------------------------------------------------------------
+/** Close the current array. */
+void JsonWriter::endArray() {
+    put(']');
+    comma_ = true;
+}
+//------------------------------------------------------------------------------
+/** Close the current object. */
+void JsonWriter::endObject() {
+    put('}');
+    comma_ = true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Write one character of a string, escaping it if needed.
+ *
+ * \param[in] c The character to write.
+ */
+void JsonWriter::escape(char c) {
+    switch (c) {
+        case '"' :
+        case '\\' :
+            put('\\');
+            put(c);
+            break;
+        case '\b' :
+            put('\\');
+            put('b');
+            break;
+        case '\f' :
+            put('\\');
+            put('f');
+            break;
+        case '\n' :
+            put('\\');
+            put('n');
+            break;
+        case '\r' :
+            put('\\');
+            put('r');
+            break;
+        case '\t' :
+            put('\\');
+            put('t');
+            break;
+        default :
+            if ((uint8_t)c < 0x20) {
+                put('\\');
+                put('u');
+                put('0');
+                put('0');
+                put(pgm_read_byte(JSON_WRITER_HEX + (c >> 4)));
+                put(pgm_read_byte(JSON_WRITER_HEX + (c & 0x0F)));
+            }
+            else
+                put(c);
+            break;
+    }
+}
+//------------------------------------------------------------------------------
+/**
+ * Write a signed integer.
+ *
+ * \param[in] value The value to write.
+ */
+void JsonWriter::integer(int32_t value) {
+    decimal(value, 0);
+}
+//------------------------------------------------------------------------------
+/**
+ * Write the key of the next member of the current object.
+ *
+ * \param[in] key The key, which is escaped if needed.
+ */
+void JsonWriter::key(const char* key) {
+    separate();
+    quote(key, false);
+    put(':');
+    comma_ = false;
+}
+//------------------------------------------------------------------------------
+/**
+ * Like key() but with a key located in the program memory.
+ *
+ * \param[in] key The key, which is escaped if needed.
+ */
+void JsonWriter::key_P(PGM_P key) {
+    separate();
+    quote(key, true);
+    put(':');
+    comma_ = false;
+}
+//------------------------------------------------------------------------------
+/** Write a null value. */
+void JsonWriter::null() {
+    separate();
+    for (PGM_P p = JSON_WRITER_NULL; pgm_read_byte(p) != 0x00; p++)
+        put(pgm_read_byte(p));
+    comma_ = true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Send one character to the output.
+ *
+ * \param[in] c The character to send.
+ */
+void JsonWriter::put(char c) {
+    if (out_ != NULL)
+        out_->write(c);
+    else if (buffer_ != NULL && length_ + 1 < size_) {
+        buffer_[length_] = c;
+        buffer_[length_ + 1] = 0x00;
+    }
+    length_++;
+}
+//------------------------------------------------------------------------------
+/**
+ * Write a quoted string.
+ *
+ * \param[in] s The string to write.
+ * \param[in] progmem Whether the string resides in program memory.
+ */
+void JsonWriter::quote(const char* s, bool progmem) {
+    put('"');
+    for (char c; (c = progmem ? pgm_read_byte(s) : *s) != 0x00; s++)
+        escape(c);
+    put('"');
+}
+//------------------------------------------------------------------------------
+/** Insert a comma if a member or an element precedes the next one. */
+void JsonWriter::separate() {
+    if (comma_)
+        put(',');
+}
+//------------------------------------------------------------------------------
+/**
+ * Write a string value.
+ *
+ * \param[in] value The string, which is escaped if needed.
+ */
+void JsonWriter::string(const char* value) {
+    separate();
+    quote(value, false);
+    comma_ = true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Like string() but with a string located in the program memory.
+ *
+ * \param[in] value The string, which is escaped if needed.
+ */
+void JsonWriter::string_P(PGM_P value) {
+    separate();
+    quote(value, true);
+    comma_ = true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Write an unsigned integer.
+ *
+ * \param[in] value The value to write.
+ */
+void JsonWriter::unsignedInteger(uint32_t value) {
+    separate();
+    // at most 10 digits
+    char digits[10];
+    uint8_t n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    while (n > 0)
+        put(digits[--n]);
+    comma_ = true;
+}
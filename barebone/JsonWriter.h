@@ -0,0 +1,90 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+/**
+ * \file
+ * \brief JsonWriter class.
+ */
+#include <Arduino.h>
+#include <Print.h>
+#include <avr/pgmspace.h>
+//------------------------------------------------------------------------------
+/**
+ * \class JsonWriter
+ * \brief Generate JSON text on the fly, inserting the separators.
+ *
+ * The text goes either to a Print (e.g. the Wifly), to a bounded buffer, or
+ * nowhere when the only purpose is to measure it. A body can thus be sent
+ * with its Content-Length without ever being held in RAM, by generating it
+ * twice from a Printable:
+ *
+ * \code
+ * size_t Telemetry::printTo(Print& p) const {
+ *     JsonWriter json(p);
+ *     json.beginObject();
+ *     json.key_P(KEY_TEMPERATURE);
+ *     json.decimal(temperature_, 1);
+ *     json.endObject();
+ *     return json.getLength();
+ * }
+ * \endcode
+ */
+class JsonWriter {
+public:
+    JsonWriter();
+    JsonWriter(Print& out);
+    JsonWriter(char* buffer, size_t bufferSize);
+    void beginArray();
+    void beginObject();
+    void boolean(bool value);
+    void decimal(int32_t value, uint8_t decimals);
+    void endArray();
+    void endObject();
+    /** \return The number of characters generated, even if truncated. */
+    size_t getLength() const {return length_;}
+    void integer(int32_t value);
+    void key(const char* key);
+    void key_P(PGM_P key);
+    void null();
+    /** \return true if the buffer was too small for the whole text. */
+    bool overflowed() const {return buffer_ != NULL && length_ >= size_;}
+    void string(const char* value);
+    void string_P(PGM_P value);
+    void unsignedInteger(uint32_t value);
+//------------------------------------------------------------------------------
+private:
+    void escape(char c);
+    void put(char c);
+    void quote(const char* s, bool progmem);
+    void separate();
+    /** Print receiving the text, NULL for a buffer or a dry run */
+    Print* out_;
+    /** Buffer receiving the text, NULL for a Print or a dry run */
+    char* buffer_;
+    /** Size of the buffer */
+    size_t size_;
+    /** Number of characters generated */
+    size_t length_;
+    /** Whether the next member or element has to be preceded by a comma */
+    bool comma_;
+};
+
+#endif // JSON_WRITER_H
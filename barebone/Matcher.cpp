@@ -0,0 +1,131 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <Matcher.h>
+//------------------------------------------------------------------------------
+/**
+ * Read one character of the pattern.
+ *
+ * \param[in] index Position of the character in the pattern.
+ *
+ * \return The character found at the given position.
+ */
+char Matcher::charAt(uint8_t index) const {
+    if (progmem_)
+        return pgm_read_byte(pattern_ + index);
+    else
+        return pattern_[index];
+}
+//------------------------------------------------------------------------------
+/**
+ * Look up the failure table.
+ *
+ * \param[in] index Position of the last matched character in the pattern.
+ *
+ * \return The number of characters which are still matched after a mismatch.
+ */
+uint8_t Matcher::fallback(uint8_t index) const {
+    return failure_[index];
+}
+//------------------------------------------------------------------------------
+/** Compute the failure table of the current pattern. */
+void Matcher::initialize() {
+    state_ = 0;
+    if (length_ == 0)
+        return;
+    failure_[0] = 0;
+    uint8_t border = 0;
+    for (uint8_t i = 1; i < length_; i++) {
+        char c = charAt(i);
+        while (border > 0 && c != charAt(border))
+            border = failure_[border - 1];
+        if (c == charAt(border))
+            border++;
+        failure_[i] = border;
+    }
+}
+//------------------------------------------------------------------------------
+/**
+ * Use a string residing in the RAM as the pattern.
+ *
+ * \param[in] pattern The string to look for.
+ *
+ * \return true is returned if the pattern is loaded, false if it is longer
+ * than MATCHER_TABLE_SIZE, in which case the matcher is left empty.
+ */
+bool Matcher::load(const char* pattern) {
+    return load(pattern, strlen(pattern), false);
+}
+//------------------------------------------------------------------------------
+/**
+ * Use a pattern once its length is known.
+ *
+ * \param[in] pattern The string to look for.
+ * \param[in] length The length of the string.
+ * \param[in] progmem Whether the string resides in program memory.
+ *
+ * \return true is returned if the pattern fits in the failure table.
+ */
+bool Matcher::load(const char* pattern, size_t length, bool progmem) {
+    if (length > MATCHER_TABLE_SIZE) {
+        pattern_ = NULL;
+        length_ = 0;
+        initialize();
+        return false;
+    }
+    pattern_ = pattern;
+    progmem_ = progmem;
+    length_ = length;
+    initialize();
+    return true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Use a string residing in program memory as the pattern.
+ *
+ * \param[in] pattern The PROGMEM string to look for.
+ *
+ * \return true is returned if the pattern is loaded, false if it is longer
+ * than MATCHER_TABLE_SIZE, in which case the matcher is left empty.
+ */
+bool Matcher::load_P(PGM_P pattern) {
+    return load(pattern, strlen_P(pattern), true);
+}
+//------------------------------------------------------------------------------
+/**
+ * Advance the automaton with one character from the stream.
+ *
+ * \param[in] c The next character of the stream.
+ *
+ * \return true is returned if c completes an occurrence of the pattern.
+ */
+bool Matcher::match(char c) {
+    if (length_ == 0)
+        return true;
+    while (state_ > 0 && c != charAt(state_))
+        state_ = fallback(state_ - 1);
+    if (c == charAt(state_))
+        state_++;
+    if (state_ == length_) {
+        // allow overlapping occurrences to be reported as well
+        state_ = fallback(length_ - 1);
+        return true;
+    }
+    return false;
+}
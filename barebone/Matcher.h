@@ -0,0 +1,75 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MATCHER_H
+#define MATCHER_H
+/**
+ * \file
+ * \brief Matcher class for single-pass string searches in a stream.
+ */
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+//------------------------------------------------------------------------------
+/** Maximum length of a pattern, which sets the size of the failure table */
+uint8_t const MATCHER_TABLE_SIZE = 32;
+//------------------------------------------------------------------------------
+/**
+ * \class Matcher
+ * \brief Knuth-Morris-Pratt automaton fed one character at a time.
+ *
+ * The failure table is computed once when the pattern is loaded, so that
+ * overlapping prefixes (e.g. "\r\n\r\n" in "\r\n\r\r\n\r\n") are never missed
+ * and the stream never has to be read twice. Patterns are limited to
+ * MATCHER_TABLE_SIZE characters, and the string functions of ExtendedStream
+ * fail right away when given a longer one.
+ */
+class Matcher {
+public:
+    /** Construct an instance of Matcher with an empty pattern. */
+    Matcher() : pattern_(NULL), progmem_(false), length_(0), state_(0) {}
+    /**
+     * Check whether a pattern has been loaded.
+     *
+     * \return true is returned if the pattern is an empty string.
+     */
+    bool empty() const {return length_ == 0;}
+    bool load(const char* pattern);
+    bool load_P(PGM_P pattern);
+    bool match(char c);
+    /** Forget any partial match */
+    void reset() {state_ = 0;}
+//------------------------------------------------------------------------------
+private:
+    char charAt(uint8_t index) const;
+    uint8_t fallback(uint8_t index) const;
+    void initialize();
+    bool load(const char* pattern, size_t length, bool progmem);
+    /** Pattern to look for */
+    const char* pattern_;
+    /** Whether the pattern resides in program memory */
+    bool progmem_;
+    /** Length of the pattern */
+    uint8_t length_;
+    /** Number of pattern characters currently matched */
+    uint8_t state_;
+    /** Length of the longest proper border of each pattern prefix */
+    uint8_t failure_[MATCHER_TABLE_SIZE];
+};
+
+#endif // MATCHER_H
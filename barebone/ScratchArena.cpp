@@ -0,0 +1,64 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <ScratchArena.h>
+//------------------------------------------------------------------------------
+/**
+ * Construct an instance of ScratchArena.
+ *
+ * \param[in] buffer The memory to allocate from, which must outlive the arena.
+ * \param[in] size The size of the memory.
+ */
+ScratchArena::ScratchArena(uint8_t* buffer, size_t size) :
+    buffer_(buffer),
+    size_(size),
+    used_(0),
+    highWater_(0)
+{
+}
+//------------------------------------------------------------------------------
+/**
+ * Allocate a block of zero-filled memory.
+ *
+ * \param[in] size The number of bytes needed.
+ *
+ * \return The address of the block, NULL if the arena is exhausted.
+ *
+ * \note Blocks are not aligned, which the AVR does not need.
+ */
+void* ScratchArena::allocate(size_t size) {
+    if (size > size_ - used_)
+        return NULL;
+    uint8_t* block = buffer_ + used_;
+    used_ += size;
+    if (used_ > highWater_)
+        highWater_ = used_;
+    memset(block, 0x00, size);
+    return block;
+}
+//------------------------------------------------------------------------------
+/**
+ * Release the blocks allocated since a checkpoint.
+ *
+ * \param[in] checkpoint A value returned by getUsed() earlier.
+ */
+void ScratchArena::release(size_t checkpoint) {
+    if (checkpoint < used_)
+        used_ = checkpoint;
+}
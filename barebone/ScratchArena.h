@@ -0,0 +1,104 @@
+/* reaDIYmate AVR library
+ * Written by Pierre Bouchet
+ * Copyright (C) 2011-2012 reaDIYmate
+ *
+ * This file is part of the reaDIYmate library.
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+/**
+ * \file
+ * \brief ScratchArena class.
+ */
+#include <Arduino.h>
+//------------------------------------------------------------------------------
+/**
+ * \class ScratchArena
+ * \brief Bump allocator for the temporary buffers of the library.
+ *
+ * Modules take their temporaries from one caller-supplied block instead of
+ * the stack, so that the RAM they need is reserved once and can be measured
+ * with getHighWater(). Memory is given back in the reverse order of the
+ * allocations, by returning to a checkpoint, which ScratchScope does
+ * automatically:
+ *
+ * \code
+ * uint8_t scratchBuffer[768];
+ * ScratchArena scratch(scratchBuffer, sizeof(scratchBuffer));
+ * ...
+ * {
+ *     ScratchScope scope(scratch);
+ *     char* path = (char*)scratch.allocate(128);
+ *     if (path == NULL)
+ *         return false;
+ *     ...
+ * } // path is released here
+ * \endcode
+ */
+class ScratchArena {
+public:
+    ScratchArena(uint8_t* buffer, size_t size);
+    void* allocate(size_t size);
+    /** \return The number of bytes which can still be allocated. */
+    size_t getAvailable() const {return size_ - used_;}
+    /** \return The largest number of bytes allocated at once so far. */
+    size_t getHighWater() const {return highWater_;}
+    /** \return The size of the arena. */
+    size_t getSize() const {return size_;}
+    /** \return The current checkpoint, i.e. the number of bytes allocated. */
+    size_t getUsed() const {return used_;}
+    void release(size_t checkpoint);
+    /** Forget the high-water mark, e.g. to measure one phase of the sketch. */
+    void resetHighWater() {highWater_ = used_;}
+//------------------------------------------------------------------------------
+private:
+    /** Memory managed by the arena */
+    uint8_t* buffer_;
+    /** Size of the memory */
+    size_t size_;
+    /** Number of bytes allocated */
+    size_t used_;
+    /** Largest value reached by used_ */
+    size_t highWater_;
+};
+//------------------------------------------------------------------------------
+/**
+ * \class ScratchScope
+ * \brief Checkpoint of a ScratchArena, released when it goes out of scope.
+ */
+class ScratchScope {
+public:
+    /**
+     * Record the current checkpoint of an arena.
+     *
+     * \param[in] arena The arena whose allocations are scoped.
+     */
+    explicit ScratchScope(ScratchArena &arena) :
+        arena_(&arena), checkpoint_(arena.getUsed()) {}
+    /** Release everything allocated since the construction. */
+    ~ScratchScope() {arena_->release(checkpoint_);}
+//------------------------------------------------------------------------------
+private:
+    // scopes cannot be copied
+    ScratchScope(const ScratchScope&);
+    ScratchScope& operator=(const ScratchScope&);
+    /** Arena whose allocations are scoped */
+    ScratchArena* arena_;
+    /** Number of bytes allocated when the scope was opened */
+    size_t checkpoint_;
+};
+
+#endif // SCRATCH_ARENA_H
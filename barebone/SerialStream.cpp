@@ -35,3 +35,41 @@ SerialStream::SerialStream(HardwareSerial &serial, uint32_t timeout) :
 SerialStream::~SerialStream() {
     serial_.end();
 }
+//------------------------------------------------------------------------------
+/**
+ * Write a block of bytes to the TX buffer of the serial port.
+ *
+ * \param[in] buffer Address of the data to send.
+ * \param[in] size Number of bytes to send.
+ *
+ * \return The number of bytes written.
+ *
+ * \note serial_ is accessed directly, so this costs one virtual call per block
+ * instead of one per byte when printing strings.
+ */
+size_t SerialStream::write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (n < size)
+        n += serial_.write(buffer[n]);
+    return n;
+}
+//------------------------------------------------------------------------------
+/**
+ * Copy the characters waiting in the RX buffer of the serial port.
+ *
+ * \param[out] buffer Address of the buffer to write data to.
+ * \param[in] length Maximum number of bytes to read into the buffer.
+ *
+ * \return The number of characters placed in the buffer (0 means no data was
+ * available).
+ *
+ * \note The number of pending bytes is sampled once and serial_ is accessed
+ * directly, so the copy involves neither virtual calls nor timeouts.
+ */
+int SerialStream::readBlock(char* buffer, size_t length) {
+    int pending = serial_.available();
+    size_t nBytes = (pending < (int)length) ? pending : length;
+    for (size_t i = 0; i < nBytes; i++)
+        buffer[i] = (char)serial_.read();
+    return nBytes;
+}
@@ -54,8 +54,11 @@ public:
      * value -1 is returned.
      */
     virtual int read() {return serial_.read();}
+    virtual int readBlock(char* buffer, size_t length);
     /** Write one byte to the stream */
     virtual size_t write(uint8_t c) {return serial_.write(c);}
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    using ExtendedStream::write;
     /** Open the stream */
     void begin(uint32_t baud) {serial_.begin(baud);}
 //------------------------------------------------------------------------------
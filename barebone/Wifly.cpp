@@ -127,6 +127,8 @@ const char PROGMEM WIFLY_FACTORY_MESSAGE[] = "Set Factory Defaults";
 /** FTP update successfully executed */
 const char PROGMEM WIFLY_UPDATE_OK[] = "UPDATE OK";
 //------------------------------------------------------------------------------
+Wifly* Wifly::instance_ = NULL;
+//------------------------------------------------------------------------------
 /**
  * Construct an instance of SerialStream.
  *
@@ -142,8 +144,23 @@ Wifly::Wifly(HardwareSerial &serial, uint8_t resetPin, uint8_t gpio4Pin,
     resetPin_(resetPin),
     gpio4Pin_(gpio4Pin),
     gpio5Pin_(gpio5Pin),
-    gpio6Pin_(gpio6Pin)
+    gpio6Pin_(gpio6Pin),
+    connectState_(CONNECT_IDLE),
+    deadline_(0),
+    commandErrors_(0),
+    wlanErrors_(0),
+    socketErrors_(0),
+    criticalErrors_(0),
+    rebooted_(false),
+    tracking_(false),
+    status_(0),
+    linkTime_(0),
+    socketTime_(0),
+    logHead_(0),
+    logCount_(0)
 {
+    host_[0] = 0x00;
+    target_[0] = 0x00;
 }
 //------------------------------------------------------------------------------
 /**
@@ -154,6 +171,8 @@ Wifly::Wifly(HardwareSerial &serial, uint8_t resetPin, uint8_t gpio4Pin,
  * \note GPIO4 goes high if the module is associated with an access point.
  */
 bool Wifly::associated() {
+    if (tracking_)
+        return status_ & WIFLY_ASSOCIATED;
     return digitalReadFast(gpio4Pin_);
 }
 //------------------------------------------------------------------------------
@@ -164,136 +183,247 @@ bool Wifly::associated() {
  * \note GPIO4 goes high if the module is associated with an access point.
  */
 bool Wifly::associated(uint16_t timeout) {
-    uint32_t start = millis();
-    while (millis() < start + timeout) {
-        if (associated())
-            return true;
-    }
-    return false;
+    return awaitStatus(WIFLY_ASSOCIATED, timeout);
 }
 //------------------------------------------------------------------------------
 /**
  * Wait for a response from the host.
  *
  * \return true if the host responded, false if it timed out.
+ *
+ * \note Bytes already received count as a response even if the host has
+ * closed the socket since, e.g. after a pipelined response.
  */
 bool Wifly::awaitResponse() {
     uint32_t start = millis();
-    while (millis() < start + SOCKET_TIMEOUT) {
-        if (connected() && available()) {
+    while (millis() - start < SOCKET_TIMEOUT) {
+        if (available()) {
             return true;
         }
+        idle();
     }
     return false;
 }
 //------------------------------------------------------------------------------
+/**
+ * Wait for the module to reach a given status.
+ *
+ * \param[in] status The status bits which must all be set.
+ * \param[in] timeout The time limit for reaching the status (in ms).
+ *
+ * \return true is returned if the status is reached before the timeout.
+ */
+bool Wifly::awaitStatus(uint8_t status, uint16_t timeout) {
+    uint32_t start = millis();
+    while ((getStatus() & status) != status) {
+        if (millis() - start >= timeout)
+            return false;
+        idle();
+    }
+    return true;
+}
+//------------------------------------------------------------------------------
 /** Force the WiFly to close the TCP connection. */
 void Wifly::closeSocket() {
     digitalWriteFast(gpio5Pin_, LOW);
 }
 //------------------------------------------------------------------------------
 /**
- * Open a socket to the host.
+ * Start the connection procedure, which is then carried out by calling
+ * connectStep().
  *
- * \return true is returned for success and false is returned for failure.
+ * \param[in] host The domain name or the IP address of the host.
+ *
+ * \return true is returned if the procedure has started, false is returned if
+ * the host name is too long.
+ */
+bool Wifly::beginConnect(const char* host) {
+    if (strlcpy(target_, host, WIFLY_HOST_BUFFER_SIZE)
+        >= WIFLY_HOST_BUFFER_SIZE) {
+        // the truncated name must not match the current host
+        target_[0] = 0x00;
+        connectState_ = CONNECT_IDLE;
+        return false;
+    }
+    wlanErrors_ = 0;
+    socketErrors_ = 0;
+    criticalErrors_ = 0;
+    rebooted_ = false;
+    connectState_ = OPENING_SOCKET;
+    return true;
+}
+//------------------------------------------------------------------------------
+/**
+ * Open a socket to the host.
  *
  * \param[in] host The domain name or the IP address of the host.
  *
  * \return true is returned for success and false is returned for failure.
+ *
+ * \note This blocks until the procedure is over, use beginConnect() and
+ * connectStep() to keep the main loop running in the meantime.
  */
 bool Wifly::connect(const char* host) {
-    enum state {
-        RESETTING,
-        ENTERING_COMMAND_MODE,
-        SETTING_HOST,
-        JOINING_WLAN,
-        OPENING_SOCKET,
-        CRITICAL_ERROR
-    } state = OPENING_SOCKET;
-
-    struct errors {
-        uint8_t wlan;
-        uint8_t socket;
-        uint8_t critical;
-    } errors = {0, 0, 0};
-
+    if (!beginConnect(host))
+        return false;
+    int8_t status;
     do {
-        switch (state) {
-            case RESETTING :
-                DEBUG_LOG("RESETTING");
-                reset();
-                state = ENTERING_COMMAND_MODE;
-                break;
-            case ENTERING_COMMAND_MODE :
-                DEBUG_LOG("ENTERING_COMMAND_MODE");
-                if (enterCommandMode())
-                    state = SETTING_HOST;
-                else
-                    state = CRITICAL_ERROR;
+        status = connectStep();
+    } while (status == WIFLY_CONNECT_PENDING);
+    return (status == WIFLY_CONNECT_OK);
+}
+//------------------------------------------------------------------------------
+/**
+ * Advance the connection procedure started by beginConnect() without waiting.
+ *
+ * \return WIFLY_CONNECT_PENDING is returned while the procedure is in
+ * progress, WIFLY_CONNECT_OK is returned once the socket is open and
+ * WIFLY_CONNECT_FAILED is returned if the procedure has given up. Once the
+ * procedure is over, WIFLY_CONNECT_OK keeps being returned for as long as
+ * the socket to the host stays open.
+ *
+ * \note The cheapest way to recover is tried first: the socket is reopened
+ * with GPIO5 while the module is associated with the right host, the module
+ * rejoins the WLAN and/or changes host from command mode otherwise, and a
+ * hardware reset is only performed when command mode cannot be entered or a
+ * critical error occurs. The only steps which still block are the commands
+ * sent to set the host, each of which is bounded by the UART timeout.
+ */
+int8_t Wifly::connectStep() {
+    switch (connectState_) {
+        case CONNECT_IDLE :
+            // the procedure is over, report how it ended
+            if (connected() && strcmp(target_, host_) == 0)
+                return WIFLY_CONNECT_OK;
+            return WIFLY_CONNECT_FAILED;
+        case RESETTING :
+            DEBUG_LOG("RESETTING");
+            pulseReset();
+            rebooted_ = true;
+            // total boot time is 150ms
+            arm(150);
+            connectState_ = BOOTING;
+            break;
+        case BOOTING :
+            if (expired())
+                requestCommandMode();
+            break;
+        case ENTERING_COMMAND_MODE :
+            if (!expired())
                 break;
-            case SETTING_HOST :
-                DEBUG_LOG("SETTING_HOST");
-                if (setHost(host)) {
-                    state = JOINING_WLAN;
-                    memset(host_, 0x00, WIFLY_HOST_BUFFER_SIZE);
-                    strlcpy(host_, host, WIFLY_HOST_BUFFER_SIZE);
+            DEBUG_LOG("ENTERING_COMMAND_MODE");
+            // request a new command prompt
+            write_P(WIFLY_ENTER_COMMAND);
+            clear();
+            prompt_.load_P(WIFLY_CMD);
+            arm(COMMAND_MODE_TIMEOUT);
+            connectState_ = AWAITING_PROMPT;
+            break;
+        case AWAITING_PROMPT : {
+            int nBytes = available();
+            while (nBytes-- > 0) {
+                if (prompt_.match(read())) {
+                    // the host is kept as long as the module is not reset
+                    if (strcmp(target_, host_) == 0)
+                        connectState_ = JOINING_WLAN;
+                    else
+                        connectState_ = SETTING_HOST;
+                    return WIFLY_CONNECT_PENDING;
                 }
-                else
-                    state = CRITICAL_ERROR;
+            }
+            if (!expired())
                 break;
-            case JOINING_WLAN :
-                DEBUG_LOG("JOINING_WLAN");
-                if (!associated())
-                    join();
-                if (associated(WLAN_TIMEOUT))
-                    state = OPENING_SOCKET;
-                else if (++errors.wlan == MAX_WLAN_ERRORS)
-                    state = CRITICAL_ERROR;
-                else
-                    delay(RETRY_INTERVAL);
+            else if (++commandErrors_ < MAX_COMMAND_ERRORS) {
+                arm(250);
+                connectState_ = ENTERING_COMMAND_MODE;
+            }
+            else
+                connectState_ = rebooted_ ? CRITICAL_ERROR : RESETTING;
+            break;
+        }
+        case SETTING_HOST :
+            DEBUG_LOG("SETTING_HOST");
+            if (setHost(target_)) {
+                strlcpy(host_, target_, WIFLY_HOST_BUFFER_SIZE);
+                connectState_ = JOINING_WLAN;
+            }
+            else
+                connectState_ = rebooted_ ? CRITICAL_ERROR : RESETTING;
+            break;
+        case JOINING_WLAN :
+            DEBUG_LOG("JOINING_WLAN");
+            if (!associated())
+                join();
+            arm(WLAN_TIMEOUT);
+            connectState_ = AWAITING_ASSOCIATION;
+            break;
+        case AWAITING_ASSOCIATION :
+            if (associated())
+                connectState_ = OPENING_SOCKET;
+            else if (!expired())
                 break;
-            case OPENING_SOCKET :
-                DEBUG_LOG("OPENING_SOCKET");
-                if (!associated()) {
-                    state = RESETTING;
-                    break;
-                }
-                else if (!connected()) {
-                    openSocket();
-                }
-
-                if (connected(SOCKET_TIMEOUT)) {
-                    if (strcmp(host, host_) != 0) {
-                        state = RESETTING;
-                        break;
-                    }
-                    return true;
-                }
-                else {
-                    // make sure the connection is closed before retrying
-                    disconnect();
-                    if (++errors.socket == MAX_SOCKET_ERRORS) {
-                        state = CRITICAL_ERROR;
-                    }
-                }
+            else if (++wlanErrors_ == MAX_WLAN_ERRORS)
+                connectState_ = CRITICAL_ERROR;
+            else {
+                arm(RETRY_INTERVAL);
+                connectState_ = RETRYING_JOIN;
+            }
+            break;
+        case RETRYING_JOIN :
+            if (expired())
+                connectState_ = JOINING_WLAN;
+            break;
+        case OPENING_SOCKET :
+            DEBUG_LOG("OPENING_SOCKET");
+            if (!associated()) {
+                requestCommandMode();
                 break;
-            case CRITICAL_ERROR :
-                DEBUG_LOG("CRITICAL_ERROR");
-                if (errors.critical == MAX_CRITICAL_ERRORS) {
+            }
+            else if (strcmp(target_, host_) != 0) {
+                // opening the socket would reach the previous host
+                disconnect();
+                requestCommandMode();
+                break;
+            }
+            else if (!connected())
+                openSocket();
+            arm(SOCKET_TIMEOUT);
+            connectState_ = AWAITING_SOCKET;
+            break;
+        case AWAITING_SOCKET :
+            if (connected()) {
+                if (strcmp(target_, host_) != 0) {
+                    // the escape sequence must not go through the socket
                     disconnect();
-                    return false;
-                }
-                else {
-                    ++errors.critical;
-                    errors.wlan = 0;
-                    errors.socket = 0;
-                    state = RESETTING;
+                    requestCommandMode();
+                    break;
                 }
+                connectState_ = CONNECT_IDLE;
+                return WIFLY_CONNECT_OK;
+            }
+            else if (!expired())
                 break;
-            default :
-                break;
-        }
-    } while (1);
+            // make sure the connection is closed before retrying
+            disconnect();
+            if (++socketErrors_ == MAX_SOCKET_ERRORS)
+                connectState_ = CRITICAL_ERROR;
+            else
+                connectState_ = OPENING_SOCKET;
+            break;
+        case CRITICAL_ERROR :
+            DEBUG_LOG("CRITICAL_ERROR");
+            if (criticalErrors_ == MAX_CRITICAL_ERRORS) {
+                disconnect();
+                connectState_ = CONNECT_IDLE;
+                return WIFLY_CONNECT_FAILED;
+            }
+            ++criticalErrors_;
+            wlanErrors_ = 0;
+            socketErrors_ = 0;
+            connectState_ = RESETTING;
+            break;
+    }
+    return WIFLY_CONNECT_PENDING;
 }
 //------------------------------------------------------------------------------
 /**
@@ -304,6 +434,8 @@ bool Wifly::connect(const char* host) {
  * \note GPIO6 goes high if the connection to the remote host is successful.
  */
 bool Wifly::connected() {
+    if (tracking_)
+        return status_ & WIFLY_CONNECTED;
     return digitalReadFast(gpio6Pin_);
 }
 //------------------------------------------------------------------------------
@@ -315,13 +447,7 @@ bool Wifly::connected() {
  * \return true is returned if the module has an open socket before the timeout.
  */
 bool Wifly::connected(uint16_t timeout) {
-    uint32_t start = millis();
-    while (millis() < start + timeout) {
-        if (connected()) {
-            return true;
-        }
-    }
-    return false;
+    return awaitStatus(WIFLY_CONNECTED, timeout);
 }
 //------------------------------------------------------------------------------
 /**
@@ -342,6 +468,34 @@ void Wifly::disconnect() {
         closeSocket();
 }
 //------------------------------------------------------------------------------
+/**
+ * Disable the pin change interrupt of a status pin.
+ *
+ * \param[in] pin The AVR pin to stop watching.
+ *
+ * \note The interrupt of the port is left enabled, since other pins may use
+ * it.
+ */
+void Wifly::disablePinChange(uint8_t pin) {
+    *digitalPinToPCMSK(pin) &= ~_BV(digitalPinToPCMSKbit(pin));
+}
+//------------------------------------------------------------------------------
+/**
+ * Enable the pin change interrupt of a status pin.
+ *
+ * \param[in] pin The AVR pin to watch.
+ *
+ * \return true is returned if the pin has a pin change interrupt.
+ */
+bool Wifly::enablePinChange(uint8_t pin) {
+    volatile uint8_t* pcicr = digitalPinToPCICR(pin);
+    if (pcicr == NULL)
+        return false;
+    *pcicr |= _BV(digitalPinToPCICRbit(pin));
+    *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+    return true;
+}
+//------------------------------------------------------------------------------
 /**
  * Get the command prompt on the WiFly module.
  *
@@ -439,6 +593,66 @@ void Wifly::getDeviceId(char* output) {
     memcpy((void*)output, (void*)mac, 12);
 }
 //------------------------------------------------------------------------------
+/**
+ * Get the time of the last association change.
+ *
+ * \return The value of millis() when GPIO4 last changed, or when initialize()
+ * was called if it has not changed since.
+ *
+ * \note Only available when the status is tracked by the interrupt handler.
+ */
+uint32_t Wifly::getLinkTime() {
+    uint32_t time;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        time = linkTime_;
+    }
+    return time;
+}
+//------------------------------------------------------------------------------
+/**
+ * Get the time of the last socket change.
+ *
+ * \return The value of millis() when GPIO6 last changed, or when initialize()
+ * was called if it has not changed since.
+ *
+ * \note Only available when the status is tracked by the interrupt handler.
+ */
+uint32_t Wifly::getSocketTime() {
+    uint32_t time;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        time = socketTime_;
+    }
+    return time;
+}
+//------------------------------------------------------------------------------
+/**
+ * Get the association and socket status.
+ *
+ * \return A combination of WIFLY_ASSOCIATED and WIFLY_CONNECTED.
+ */
+uint8_t Wifly::getStatus() {
+    if (tracking_)
+        return status_;
+    return readStatus();
+}
+//------------------------------------------------------------------------------
+/** Update the status of the module from the pin change interrupt handler. */
+void Wifly::handlePinChange() {
+    if (instance_ != NULL)
+        instance_->updateStatus();
+}
+//------------------------------------------------------------------------------
+/**
+ * Let the CPU sleep until the next interrupt when the status is tracked, which
+ * is at most until the next tick of millis().
+ */
+void Wifly::idle() {
+    if (!tracking_)
+        return;
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_mode();
+}
+//------------------------------------------------------------------------------
 /** Initialize the WiFly module. */
 void Wifly::initialize() {
     begin(FULL_SPEED);
@@ -446,6 +660,14 @@ void Wifly::initialize() {
     pinModeFast(gpio4Pin_, INPUT);
     pinModeFast(gpio5Pin_, OUTPUT);
     pinModeFast(gpio6Pin_, INPUT);
+    // the status pins are polled until trackStatus() is called
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        status_ = readStatus();
+        linkTime_ = millis();
+        socketTime_ = linkTime_;
+        logCount_ = 0;
+        instance_ = this;
+    }
 }
 //------------------------------------------------------------------------------
 /* Command the WiFly to join the WLAN stored in memory. */
@@ -461,15 +683,72 @@ void Wifly::openSocket() {
     digitalWriteFast(gpio5Pin_, HIGH);
 }
 //------------------------------------------------------------------------------
-/** Perform a hardware reset of the WiFly module. */
-void Wifly::reset() {
+/**
+ * Pulse the reset pin of the WiFly module, without waiting for it to boot.
+ */
+void Wifly::pulseReset() {
     digitalWriteFast(resetPin_, LOW);
     delay(1);
     digitalWriteFast(resetPin_, HIGH);
+    // the host set from command mode is not saved
+    host_[0] = 0x00;
+}
+//------------------------------------------------------------------------------
+/** Perform a hardware reset of the WiFly module. */
+void Wifly::reset() {
+    pulseReset();
     // total boot time is 150ms
     delay(150);
 }
 //------------------------------------------------------------------------------
+/**
+ * Read the status pins.
+ *
+ * \return A combination of WIFLY_ASSOCIATED and WIFLY_CONNECTED.
+ */
+uint8_t Wifly::readStatus() {
+    uint8_t status = 0;
+    if (digitalReadFast(gpio4Pin_))
+        status |= WIFLY_ASSOCIATED;
+    if (digitalReadFast(gpio6Pin_))
+        status |= WIFLY_CONNECTED;
+    return status;
+}
+//------------------------------------------------------------------------------
+/**
+ * Get the oldest status transition which has not been read yet.
+ *
+ * \param[out] transition The location the transition will be written to.
+ *
+ * \return true is returned if a transition was available.
+ *
+ * \note Only the last WIFLY_LOG_SIZE transitions are kept.
+ */
+bool Wifly::readTransition(WiflyTransition* transition) {
+    bool found = false;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (logCount_ > 0) {
+            transition->time = log_[logHead_].time;
+            transition->status = log_[logHead_].status;
+            logHead_ = (logHead_ + 1) % WIFLY_LOG_SIZE;
+            logCount_--;
+            found = true;
+        }
+    }
+    return found;
+}
+//------------------------------------------------------------------------------
+/**
+ * Wait for the guard time of the escape sequence before asking for a command
+ * prompt within the connection procedure.
+ */
+void Wifly::requestCommandMode() {
+    commandErrors_ = 0;
+    // there is a 250ms buffer before the escape sequence
+    arm(250);
+    connectState_ = ENTERING_COMMAND_MODE;
+}
+//------------------------------------------------------------------------------
 /** Reset the baudrate of the wifly module to 9600 */
 bool Wifly::resetBaudrateAndFirmware() {
     DEBUG_LOG("Resetting the RN171 firmware.");
@@ -678,6 +957,37 @@ bool Wifly::setWlanConfig(const char* ssid, const char* passphrase, const char*
     return true;
 }
 //------------------------------------------------------------------------------
+/**
+ * Track the status pins from the pin change interrupt handlers rather than
+ * polling them.
+ *
+ * \return true is returned if both GPIO4 and GPIO6 have a pin change
+ * interrupt, false if they keep being polled.
+ *
+ * \note The sketch must define the handlers, by expanding
+ * WIFLY_PIN_CHANGE_ISR() once or by calling handlePinChange() from its own
+ * ones, otherwise the first pin change resets the board. initialize() must
+ * have been called beforehand.
+ */
+bool Wifly::trackStatus() {
+    bool gpio4Tracked = enablePinChange(gpio4Pin_);
+    bool gpio6Tracked = enablePinChange(gpio6Pin_);
+    if (!gpio4Tracked || !gpio6Tracked) {
+        // a single interrupt is no use, both pins keep being polled
+        if (gpio4Tracked)
+            disablePinChange(gpio4Pin_);
+        if (gpio6Tracked)
+            disablePinChange(gpio6Pin_);
+        return false;
+    }
+    // read the pins once the interrupts are on, so that no change is missed
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        status_ = readStatus();
+        tracking_ = true;
+    }
+    return true;
+}
+//------------------------------------------------------------------------------
 /** Update the RN171 firmware to the latest version. */
 bool Wifly::updateFirmware() {
     begin(FULL_SPEED);
@@ -740,3 +1050,26 @@ bool Wifly::updateFirmware() {
 
     return true;
 }
+//------------------------------------------------------------------------------
+/** Record a change of the status pins, called with interrupts disabled. */
+void Wifly::updateStatus() {
+    uint8_t status = readStatus();
+    uint8_t changes = status ^ status_;
+    // the interrupt may come from another pin of the same port
+    if (changes == 0)
+        return;
+    uint32_t now = millis();
+    if (changes & WIFLY_ASSOCIATED)
+        linkTime_ = now;
+    if (changes & WIFLY_CONNECTED)
+        socketTime_ = now;
+    status_ = status;
+    // the oldest transition is dropped when the log is full
+    uint8_t index = (logHead_ + logCount_) % WIFLY_LOG_SIZE;
+    if (logCount_ == WIFLY_LOG_SIZE)
+        logHead_ = (logHead_ + 1) % WIFLY_LOG_SIZE;
+    else
+        logCount_++;
+    log_[index].time = now;
+    log_[index].status = status;
+}
@@ -23,7 +23,10 @@
  * \file
  * \brief Wifly class for the Roving Networks GSX/EZX Wi-Fi modules.
  */
+#include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
 #include <digitalWriteFast.h>
 #include <SerialStream.h>
 #include <BufferedStream.h>
@@ -31,42 +34,136 @@
 /** Size of the buffer used to hold the host name */
 uint8_t const WIFLY_HOST_BUFFER_SIZE = 32;
 //------------------------------------------------------------------------------
+// Values returned by connectStep()
+/** The connection could not be established */
+int8_t const WIFLY_CONNECT_FAILED = -1;
+/** The connection is still being established */
+int8_t const WIFLY_CONNECT_PENDING = 0;
+/** The socket to the host is open */
+int8_t const WIFLY_CONNECT_OK = 1;
+//------------------------------------------------------------------------------
+// Status bits reported by getStatus()
+/** The module is associated with an access point (GPIO4) */
+uint8_t const WIFLY_ASSOCIATED = 0x01;
+/** The module has an open TCP socket (GPIO6) */
+uint8_t const WIFLY_CONNECTED = 0x02;
+/** Number of status transitions kept until they are read */
+uint8_t const WIFLY_LOG_SIZE = 8;
+//------------------------------------------------------------------------------
+/**
+ * \struct WiflyTransition
+ * \brief Change of the association or socket status.
+ */
+struct WiflyTransition {
+    /** Time of the change (in ms) */
+    uint32_t time;
+    /** Status bits after the change */
+    uint8_t status;
+};
+//------------------------------------------------------------------------------
+/**
+ * \def WIFLY_PIN_CHANGE_ISR()
+ * Define the pin change interrupt handlers which Wifly::trackStatus() relies
+ * on. The vectors are left alone unless a sketch expands this macro once, so
+ * that other libraries can use them.
+ */
+#if defined(PCINT2_vect)
+#define WIFLY_PIN_CHANGE_ISR() \
+    ISR(PCINT0_vect) {Wifly::handlePinChange();} \
+    ISR(PCINT1_vect, ISR_ALIASOF(PCINT0_vect)); \
+    ISR(PCINT2_vect, ISR_ALIASOF(PCINT0_vect))
+#elif defined(PCINT1_vect)
+#define WIFLY_PIN_CHANGE_ISR() \
+    ISR(PCINT0_vect) {Wifly::handlePinChange();} \
+    ISR(PCINT1_vect, ISR_ALIASOF(PCINT0_vect))
+#else
+#define WIFLY_PIN_CHANGE_ISR() \
+    ISR(PCINT0_vect) {Wifly::handlePinChange();}
+#endif
+//------------------------------------------------------------------------------
 /**
  * \class Wifly
  * \brief Send HTTP requests and fetch data with a RN131 or RN171 module.
+ *
+ * The levels of GPIO4 and GPIO6 are polled by default. When they are wired to
+ * pins with pin change interrupts, a sketch which expands
+ * WIFLY_PIN_CHANGE_ISR() and calls trackStatus() has them tracked by an
+ * interrupt handler instead, so that checking the status costs nothing and
+ * waiting for it lets the CPU sleep.
  */
 class Wifly : public SerialStream {
 public:
     Wifly(HardwareSerial &serial, uint8_t resetPin, uint8_t gpio4Pin,
         uint8_t gpio5Pin, uint8_t gpio6Pin);
     bool awaitResponse();
+    bool beginConnect(const char* host);
     bool connect(const char* host);
+    int8_t connectStep();
     bool connected();
     bool connected(uint16_t timeout);
     bool connectedTo_P(PGM_P host);
     void disconnect();
     bool enterCommandMode();
     void getDeviceId(char* output);
+    uint32_t getLinkTime();
+    uint32_t getSocketTime();
+    uint8_t getStatus();
+    static void handlePinChange();
     void initialize();
+    bool readTransition(WiflyTransition* transition);
     void reset();
     bool resetBaudrateAndFirmware();
     bool resetConfigToDefault();
     bool setWlanConfig(const char* ssid, const char* passphrase,
         const char* ip = NULL, const char* mask = NULL,
         const char* gateway = NULL);
+    bool trackStatus();
     bool updateFirmware();
 //------------------------------------------------------------------------------
 private:
+    /** Steps of the connection procedure */
+    enum ConnectState {
+        CONNECT_IDLE,
+        RESETTING,
+        BOOTING,
+        ENTERING_COMMAND_MODE,
+        AWAITING_PROMPT,
+        SETTING_HOST,
+        JOINING_WLAN,
+        AWAITING_ASSOCIATION,
+        RETRYING_JOIN,
+        OPENING_SOCKET,
+        AWAITING_SOCKET,
+        CRITICAL_ERROR
+    };
+    /**
+     * Start waiting for an event of the connection procedure.
+     *
+     * \param[in] duration The time after which the wait is over (in ms).
+     */
+    void arm(uint32_t duration) {deadline_ = millis() + duration;}
     bool associated();
     bool associated(uint16_t timeout);
+    bool awaitStatus(uint8_t status, uint16_t timeout);
     void closeSocket();
+    void disablePinChange(uint8_t pin);
+    bool enablePinChange(uint8_t pin);
+    /** \return true once the time given to arm() has elapsed. */
+    bool expired() const {return (int32_t)(millis() - deadline_) >= 0;}
     bool executeCommand(PGM_P commandIndex, PGM_P expectedReturnIndex,
         const char* parameter = NULL);
     bool executeCommand(PGM_P commandIndex, PGM_P expectedReturnIndex,
         long parameter);
+    void idle();
     void join();
     void openSocket();
+    void pulseReset();
+    uint8_t readStatus();
+    void requestCommandMode();
     bool setHost(const char* host);
+    void updateStatus();
+    /** Instance notified of pin changes */
+    static Wifly* instance_;
     /** Hardware reset pin */
     const uint8_t resetPin_;
     /** Access point status pin (GPIO4) */
@@ -77,6 +174,38 @@ private:
     const uint8_t gpio6Pin_;
     /** Host name buffer */
     char host_[WIFLY_HOST_BUFFER_SIZE];
+    /** Host the connection procedure is connecting to */
+    char target_[WIFLY_HOST_BUFFER_SIZE];
+    /** Current step of the connection procedure */
+    ConnectState connectState_;
+    /** End of the current wait of the connection procedure */
+    uint32_t deadline_;
+    /** Failed attempts to get a command prompt */
+    uint8_t commandErrors_;
+    /** Failed attempts to associate with the access point */
+    uint8_t wlanErrors_;
+    /** Failed attempts to open a socket to the host */
+    uint8_t socketErrors_;
+    /** Critical errors since the beginning of the connection procedure */
+    uint8_t criticalErrors_;
+    /** Whether the module has been reset by the connection procedure */
+    bool rebooted_;
+    /** Automaton looking for the command prompt */
+    Matcher prompt_;
+    /** Whether status_ is kept up to date by the pin change interrupt */
+    bool tracking_;
+    /** Status bits at the last pin change */
+    volatile uint8_t status_;
+    /** Time of the last association change (in ms) */
+    volatile uint32_t linkTime_;
+    /** Time of the last socket change (in ms) */
+    volatile uint32_t socketTime_;
+    /** Transitions which have not been read yet */
+    volatile WiflyTransition log_[WIFLY_LOG_SIZE];
+    /** Index of the oldest transition in the log */
+    volatile uint8_t logHead_;
+    /** Number of transitions in the log */
+    volatile uint8_t logCount_;
 };
 
 #endif // WIFLY_H
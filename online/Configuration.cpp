@@ -86,6 +86,49 @@ const char PROGMEM WIZARD_AOK[] = "AOK\r\n";
 /** Command error */
 const char PROGMEM WIZARD_ERR[] = "ERR\r\n";
 //------------------------------------------------------------------------------
+// Settings sent by the Companion
+/** Pusher settings */
+struct PusherSettings {
+    char key[22];
+    char secret[22];
+    char channel[22];
+};
+/** Members of the Pusher message */
+const JsonField PUSHER_FIELDS[] PROGMEM = {
+    JSON_FIELD(WIZARD_KEY_KEY, JSON_FIELD_STRING, PusherSettings, key),
+    JSON_FIELD(WIZARD_KEY_SECRET, JSON_FIELD_STRING, PusherSettings, secret),
+    JSON_FIELD(WIZARD_KEY_CHANNEL, JSON_FIELD_STRING, PusherSettings, channel)
+};
+/** reaDIYmate website credentials */
+struct UserSettings {
+    char username[64];
+    char password[128];
+};
+/** Members of the authentication message */
+const JsonField USER_FIELDS[] PROGMEM = {
+    JSON_FIELD(WIZARD_KEY_USER, JSON_FIELD_STRING, UserSettings, username),
+    JSON_FIELD(WIZARD_KEY_PASSWORD, JSON_FIELD_STRING, UserSettings, password)
+};
+/** WLAN settings */
+struct WifiSettings {
+    char mode[8];
+    char ip[16];
+    char mask[16];
+    char gateway[16];
+    char ssid[32];
+    char passphrase[64];
+};
+/** Members of the WLAN message */
+const JsonField WIFI_FIELDS[] PROGMEM = {
+    JSON_FIELD(WIZARD_KEY_MODE, JSON_FIELD_STRING, WifiSettings, mode),
+    JSON_FIELD(WIZARD_KEY_IP, JSON_FIELD_STRING, WifiSettings, ip),
+    JSON_FIELD(WIZARD_KEY_NETMASK, JSON_FIELD_STRING, WifiSettings, mask),
+    JSON_FIELD(WIZARD_KEY_GATEWAY, JSON_FIELD_STRING, WifiSettings, gateway),
+    JSON_FIELD(WIZARD_KEY_SSID, JSON_FIELD_STRING, WifiSettings, ssid),
+    JSON_FIELD(WIZARD_KEY_PASSPHRASE, JSON_FIELD_STRING, WifiSettings,
+        passphrase)
+};
+//------------------------------------------------------------------------------
 /** Format string used to construct the credential for API calls */
 const char API_CREDENTIAL_FORMAT[] PROGMEM = "id=%s&user=%s&token=%s";
 //------------------------------------------------------------------------------
@@ -94,17 +137,49 @@ const char API_CREDENTIAL_FORMAT[] PROGMEM = "id=%s&user=%s&token=%s";
  *
  * \param[in] companion The serial port that is connected to the companion.
  * \param[in] wifly The Wifly object to use for communications.
+ * \param[in] sdChipSelectPin The AVR pin connected to the CS pin of the SD
+ * card.
+ *
+ * \note The temporary buffers are taken from the stack while synchronizing.
  */
 Configuration::Configuration(HardwareSerial &companion, Wifly &wifly,
     uint8_t sdChipSelectPin) :
     SerialStream(companion, WIZARD_TIMEOUT),
+    username_(NULL),
+    password_(NULL),
+    key_(NULL),
+    secret_(NULL),
+    channel_(NULL),
     wifly_(&wifly),
-    sdChipSelectPin_(sdChipSelectPin),
+    scratch_(NULL),
+    sdChipSelectPin_(sdChipSelectPin)
+{
+    restoreDeviceId();
+    restoreUserAndPass();
+    restorePusher();
+}
+//------------------------------------------------------------------------------
+/**
+ * Construct an instance of Configuration.
+ *
+ * \param[in] companion The serial port that is connected to the companion.
+ * \param[in] wifly The Wifly object to use for communications.
+ * \param[in] scratch The arena providing the temporary buffers, which must be
+ * able to hold WIZARD_SCRATCH_SIZE bytes.
+ * \param[in] sdChipSelectPin The AVR pin connected to the CS pin of the SD
+ * card.
+ */
+Configuration::Configuration(HardwareSerial &companion, Wifly &wifly,
+    ScratchArena &scratch, uint8_t sdChipSelectPin) :
+    SerialStream(companion, WIZARD_TIMEOUT),
     username_(NULL),
     password_(NULL),
     key_(NULL),
     secret_(NULL),
-    channel_(NULL)
+    channel_(NULL),
+    wifly_(&wifly),
+    scratch_(&scratch),
+    sdChipSelectPin_(sdChipSelectPin)
 {
     restoreDeviceId();
     restoreUserAndPass();
@@ -222,25 +297,30 @@ uint8_t Configuration::getServoDefaultPosition() {
 bool Configuration::readPusher(char* buffer, uint8_t bufferSize) {
     JsonStream json = JsonStream(buffer, bufferSize);
 
-    char key[22] = {0};
-    char secret[22] = {0};
-    char channel[22] = {0};
-
-    json.getStringByName_P(WIZARD_KEY_KEY, key, 22);
-    json.getStringByName_P(WIZARD_KEY_SECRET, secret, 22);
-    json.getStringByName_P(WIZARD_KEY_CHANNEL, channel, 22);
+    ScratchScope scope(*scratch_);
+    PusherSettings* settings =
+        (PusherSettings*)scratch_->allocate(sizeof(PusherSettings));
+    if (settings == NULL) {
+        return false;
+    }
+    json.extract_P(PUSHER_FIELDS, 3, settings);
 
-    if (strlen(key) == 0) {
+    if (strlen(settings->key) == 0) {
         return false;
     }
 
-    if (strcmp(key_, key) != 0
-    || strcmp(secret_, secret) != 0
-    || strcmp(channel_, channel) != 0) {
-        key_ = key;
-        secret_ = secret;
-        channel_ = channel;
+    if (strcmp(key_, settings->key) != 0
+    || strcmp(secret_, settings->secret) != 0
+    || strcmp(channel_, settings->channel) != 0) {
+        free(key_);
+        free(secret_);
+        free(channel_);
+        key_ = settings->key;
+        secret_ = settings->secret;
+        channel_ = settings->channel;
         savePusher();
+        // the settings are released with the scope, keep the saved copies
+        restorePusher();
     }
 
     return true;
@@ -261,21 +341,27 @@ bool Configuration::readServoDefaultPosition(char* buffer, uint8_t bufferSize) {
 bool Configuration::readUserAndPass(char* buffer, uint8_t bufferSize) {
     JsonStream json = JsonStream(buffer, bufferSize);
 
-    char newUsername[64] = {0};
-    char newPassword[128] = {0};
-
-    json.getStringByName_P(WIZARD_KEY_USER, newUsername, 64);
-    json.getStringByName_P(WIZARD_KEY_PASSWORD, newPassword, 128);
+    ScratchScope scope(*scratch_);
+    UserSettings* settings =
+        (UserSettings*)scratch_->allocate(sizeof(UserSettings));
+    if (settings == NULL) {
+        return false;
+    }
+    json.extract_P(USER_FIELDS, 2, settings);
 
-    if (strlen(newUsername) == 0 || strlen(newPassword) == 0) {
+    if (strlen(settings->username) == 0 || strlen(settings->password) == 0) {
         return false;
     }
 
-    if (strcmp(username_, newUsername) != 0
-    || strcmp(password_, newPassword) != 0) {
-        username_ = newUsername;
-        password_ = newPassword;
+    if (strcmp(username_, settings->username) != 0
+    || strcmp(password_, settings->password) != 0) {
+        free(username_);
+        free(password_);
+        username_ = settings->username;
+        password_ = settings->password;
         saveUserAndPass();
+        // the settings are released with the scope, keep the saved copies
+        restoreUserAndPass();
     }
 
     return true;
@@ -285,35 +371,32 @@ bool Configuration::readUserAndPass(char* buffer, uint8_t bufferSize) {
 bool Configuration::readWifiSettings(char* buffer, uint8_t bufferSize) {
     JsonStream json = JsonStream(buffer, bufferSize);
 
-    // parse the individual settings one by one
-    char mode[8] = {0};
-    json.getStringByName_P(WIZARD_KEY_MODE, mode, 8);
-    char ip[16] = {0};
-    json.getStringByName_P(WIZARD_KEY_IP, ip, 16);
-    char mask[16] = {0};
-    json.getStringByName_P(WIZARD_KEY_NETMASK, mask, 16);
-    char gateway[16] = {0};
-    json.getStringByName_P(WIZARD_KEY_GATEWAY, gateway, 16);
-    char ssid[32] = {0};
-    json.getStringByName_P(WIZARD_KEY_SSID, ssid, 32);
-    char passphrase[64] = {0};
-    json.getStringByName_P(WIZARD_KEY_PASSPHRASE, passphrase, 64);
+    // parse all the settings in a single pass
+    ScratchScope scope(*scratch_);
+    WifiSettings* settings =
+        (WifiSettings*)scratch_->allocate(sizeof(WifiSettings));
+    if (settings == NULL) {
+        return false;
+    }
+    json.extract_P(WIFI_FIELDS, 6, settings);
 
     // check the validity of the new settings
-    bool dhcp = (strcmp_P(mode, WIZARD_DHCP) == 0);
-    if (strlen(ssid) == 0 || strlen(passphrase) == 0) {
+    bool dhcp = (strcmp_P(settings->mode, WIZARD_DHCP) == 0);
+    if (strlen(settings->ssid) == 0 || strlen(settings->passphrase) == 0) {
         return false;
     }
-    if (dhcp == false && (strlen(ip) == 0 || strlen(mask) == 0 || strlen(gateway) == 0)) {
+    if (dhcp == false && (strlen(settings->ip) == 0
+    || strlen(settings->mask) == 0 || strlen(settings->gateway) == 0)) {
         return false;
     }
 
     // update the configuration of the Wi-Fi module
     if (dhcp == true) {
-        return wifly_->setWlanConfig(ssid, passphrase);
+        return wifly_->setWlanConfig(settings->ssid, settings->passphrase);
     }
     else {
-        return wifly_->setWlanConfig(ssid, passphrase, ip, mask, gateway);
+        return wifly_->setWlanConfig(settings->ssid, settings->passphrase,
+            settings->ip, settings->mask, settings->gateway);
     }
 }
 //------------------------------------------------------------------------------
@@ -439,15 +522,31 @@ void Configuration::sendDeviceId() {
  * \param[in] timeout Timeout used to decide when to abort the synchronization.
  */
 void Configuration::synchronize(uint16_t timeout) {
-    char buffer[512] = {0};
+    if (scratch_ == NULL) {
+        // without an arena from the sketch, use one on the stack meanwhile
+        uint8_t block[WIZARD_SCRATCH_SIZE];
+        ScratchArena scratch(block, sizeof(block));
+        scratch_ = &scratch;
+        synchronize(timeout);
+        scratch_ = NULL;
+        return;
+    }
+    ScratchScope scope(*scratch_);
+    char* buffer = (char*)scratch_->allocate(WIZARD_BUFFER_SIZE);
+    if (buffer == NULL) {
+        DEBUG_LOG("Not enough scratch memory to synchronize.");
+        return;
+    }
     write_P(WIZARD_STARTUP);
 
     uint32_t deadline = millis() + timeout;
     while (millis() < deadline) {
-        memset(buffer, 0x00, 512);
-        int nBytes = readBytesUntil(COMMAND_END_CHAR, buffer, 511);
+        memset(buffer, 0x00, WIZARD_BUFFER_SIZE);
+        int nBytes = readBytesUntil(COMMAND_END_CHAR, buffer,
+            WIZARD_BUFFER_SIZE - 1);
         buffer[nBytes] = COMMAND_END_CHAR;
-        JsonStream json = JsonStream(buffer, nBytes);
+        // the closing brace is part of the message, so it can be indexed
+        JsonStream json = JsonStream(buffer, nBytes + 1);
 
         char cmd[16] = {0};
         int cmdLen = json.getStringByName_P(COMMAND_TYPE, cmd, 16);
@@ -466,7 +565,7 @@ void Configuration::synchronize(uint16_t timeout) {
             }
             else if (strcmp_P(cmd, COMMAND_AUTH) == 0) {
                 DEBUG_LOG("Command received: set authentication.");
-                if (readUserAndPass(buffer, nBytes)) {
+                if (readUserAndPass(buffer, nBytes + 1)) {
                     DEBUG_LOG("Authentication settings accepted.");
                     write_P(WIZARD_AOK);
                 }
@@ -478,7 +577,7 @@ void Configuration::synchronize(uint16_t timeout) {
             }
             else if (strcmp_P(cmd, COMMAND_WLAN) == 0) {
                 DEBUG_LOG("Command received: set WLAN config.");
-                if (readWifiSettings(buffer, nBytes)) {
+                if (readWifiSettings(buffer, nBytes + 1)) {
                     DEBUG_LOG("WLAN config accepted.");
                     write_P(WIZARD_AOK);
                 }
@@ -490,7 +589,7 @@ void Configuration::synchronize(uint16_t timeout) {
             }
             else if (strcmp_P(cmd, COMMAND_PUSHER) == 0) {
                 DEBUG_LOG("Command received: setup Pusher messaging.");
-                if (readPusher(buffer, nBytes)) {
+                if (readPusher(buffer, nBytes + 1)) {
                     DEBUG_LOG("Pusher information accepted.");
                     write_P(WIZARD_AOK);
                 }
@@ -509,7 +608,7 @@ void Configuration::synchronize(uint16_t timeout) {
             }
             else if (strcmp_P(cmd, COMMAND_SERVO) == 0) {
                 DEBUG_LOG("Command received: set servo origin.");
-                if (readServoDefaultPosition(buffer, nBytes)) {
+                if (readServoDefaultPosition(buffer, nBytes + 1)) {
                     DEBUG_LOG("Servo origin set.");
                     write_P(WIZARD_AOK);
                 }
@@ -27,10 +27,19 @@
 #include <avr/pgmspace.h>
 #include <eepromAddresses.h>
 #include <JsonStream.h>
+#include <ScratchArena.h>
 #include <SerialStream.h>
 #include <Wifly.h>
 #include <StatusLed.h>
 //------------------------------------------------------------------------------
+/** Size of the buffer holding a command sent by the Companion */
+uint16_t const WIZARD_BUFFER_SIZE = 512;
+/**
+ * Minimum size of the arena given to Configuration: the command buffer plus
+ * the largest settings parsed from it (user name and password, 192 bytes)
+ */
+uint16_t const WIZARD_SCRATCH_SIZE = WIZARD_BUFFER_SIZE + 192;
+//------------------------------------------------------------------------------
 /**
  * \class Configuration
  * \brief Read, write and update the object configuration stored in the EEPROM.
@@ -39,6 +48,8 @@ class Configuration : public SerialStream {
 public:
     Configuration(HardwareSerial &companion, Wifly &wifly,
         uint8_t sdChipSelectPin);
+    Configuration(HardwareSerial &companion, Wifly &wifly,
+        ScratchArena &scratch, uint8_t sdChipSelectPin);
     ~Configuration();
     void getApiCredential(char* buffer, uint8_t bufferSize);
     const char* getPusherKey() {return key_;}
@@ -76,6 +87,8 @@ private:
     char* channel_;
     /** The WiFly module manager */
     Wifly* wifly_;
+    /** Arena providing the temporary buffers */
+    ScratchArena* scratch_;
     uint8_t sdChipSelectPin_;
 };
 